@@ -1,14 +1,26 @@
-#define _DEFAULT_SOURCE
-#define NB_THREADS 8
+#define _GNU_SOURCE
 #define CACHE_LINE_SIZE 64
+#define THREAD_FIND_MIN_SIZE 65536
+#include <errno.h>
+#include <fcntl.h>
 #include <immintrin.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef FIND_STATS
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 // Written by Charles MASSON
 
@@ -36,287 +48,4098 @@ void initialize_count_ones_table() {
         count_ones_table[i] = count_ones(i);
 }
 
+/*
+permutation_table
+-----------------
+permutation_table[mask] contains, in its k-th group of 4 bits, the position of the k-th one in the binary value of mask
+(and half_permutation_table[mask][k] for the 16 masks of 4 bits). Adding these positions to the index of the first
+integer of a group gives the indices of its occurrences, so that the vector computing kernels write them with a single
+store whose length does not matter, instead of looping over the bits of the mask.
+*/
+
+unsigned int permutation_table[256];
+int half_permutation_table[16][4];
+
+void initialize_permutation_table() {
+    for (int mask = 0; mask < 256; mask++) {
+        permutation_table[mask] = 0;
+        for (int b = 0, k = 0; b < 8; b++)
+            if (mask & (1 << b))
+                permutation_table[mask] |= (unsigned int) b << (4 * k++);
+    }
+    for (int mask = 0; mask < 16; mask++)
+        for (int k = 0; k < 4; k++)
+            half_permutation_table[mask][k] = (permutation_table[mask] >> (4 * k)) & 0xF;
+}
+
 /*
 get_time_ns()
 -------------
-Used to measure the execution time.
+Used to measure the execution time. CLOCK_MONOTONIC does not jump when the system time is changed (e.g., by NTP).
 */
 
 long get_time_ns() {
     struct timespec t;
-    clock_gettime(CLOCK_REALTIME, &t);
+    clock_gettime(CLOCK_MONOTONIC, &t);
     return t.tv_nsec + t.tv_sec * 1E9L;
 }
 
 /*
-generate_U()
-------------
-Generates an array of random integers.
+Instrumentation
+---------------
+When the program is compiled with -DFIND_STATS, thread_pred_find (and thus thread_find) and find_ctx_pred_find record
+the statistics of each search in find_stats, which find_get_stats returns. find_stats is thread-local: it describes the
+last search of the calling thread, so that concurrent searches from different threads do not overwrite each other's.
+For each thread of the search (see find_thread_stats), it contains the time spent in the kernel, the number of steps of
+its chunk, the number of indices it wrote and of reallocations of its buffer and, when k >= 0 and the search stopped
+early, the time from the moment the k-th occurrence was published to the moment the kernel returned (stop latency).
+It also contains the cycles, last level cache misses and branch misses of the thread, read with perf_event_open (-1 if
+the counters are not available, e.g., when perf_event_paranoid forbids them), whose file descriptors are opened once by
+each thread. imbalance is the ratio of the longest kernel time to the average one (1 when the chunks take the same
+time). Searches that do not wake up the threads (below THREAD_FIND_MIN_SIZE) only record total_ns, with nb_threads = 0.
+Without FIND_STATS, none of this is compiled and the threads only run the kernels.
+*/
+
+#ifdef FIND_STATS
+
+#define FIND_STATS_NB_COUNTERS 3
+
+struct find_thread_stats {
+    long scan_ns;
+    long nb_steps;
+    int nb_find;
+    int nb_grows;
+    long stop_latency_ns;
+    long counters[FIND_STATS_NB_COUNTERS];
+};
+
+struct find_stats {
+    long total_ns;
+    int nb_threads;
+    struct find_thread_stats *threads;
+    double imbalance;
+    long stop_latency_ns;
+};
+
+_Thread_local struct find_stats find_stats = {0, 0, NULL, 1, -1};
+_Thread_local int find_stats_nb_grows = 0;
+_Thread_local int find_stats_perf_fds[FIND_STATS_NB_COUNTERS] = {-2, -2, -2};
+
+const struct find_stats *find_get_stats() {
+    return &find_stats;
+}
+
+// Writes the cycles, last level cache misses and branch misses of the calling thread so far to counters (-1 for those
+// that are not available). The counters are opened on the first call.
+void find_stats_read_counters(long *counters) {
+    static const unsigned long configs[FIND_STATS_NB_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int c = 0; c < FIND_STATS_NB_COUNTERS; c++) {
+        if (find_stats_perf_fds[c] == -2) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[c];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            find_stats_perf_fds[c] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+        long long value;
+        counters[c] = find_stats_perf_fds[c] >= 0 && read(find_stats_perf_fds[c], &value, sizeof(value)) ==
+            sizeof(value) ? value : -1;
+    }
+}
+
+void find_stats_close_counters() {
+    for (int c = 0; c < FIND_STATS_NB_COUNTERS; c++) {
+        if (find_stats_perf_fds[c] >= 0)
+            close(find_stats_perf_fds[c]);
+        find_stats_perf_fds[c] = -2;
+    }
+}
+
+void find_stats_print(const struct find_stats *stats) {
+    printf("Total: %liµs, imbalance: %.2f, stop latency: %lins\n", stats->total_ns / 1000, stats->imbalance,
+           stats->stop_latency_ns);
+    for (int t = 0; t < stats->nb_threads; t++) {
+        const struct find_thread_stats *thread = &stats->threads[t];
+        printf("Thread %i: %liµs, %li steps, %i indices, %i reallocations, %li cycles, %li LLC misses, "
+               "%li branch misses\n", t, thread->scan_ns / 1000, thread->nb_steps, thread->nb_find, thread->nb_grows,
+               thread->counters[0], thread->counters[1], thread->counters[2]);
+    }
+}
+
+#endif
+
+/*
+Output buffer
+-------------
+ind_buffer contains the indices of the found occurrences. Its capacity grows geometrically, so that the number of
+reallocations is logarithmic in the number of occurrences instead of being proportional to it, which keeps the
+allocator out of the hot loops. ind_buffer_release hands the indices over to the caller as an array of exactly
+nb_find integers.
+In the hot loops, the kernels keep the number of indices in a local variable (i.e., in a register) rather than updating
+buffer->size for each occurrence, and only write it back to buffer->size when the buffer grows and when they return.
+*/
+
+#define IND_BUFFER_MIN_CAPACITY 1024
+
+struct ind_buffer {
+    int *data;
+    int size;
+    int capacity;
+};
+
+void ind_buffer_init(struct ind_buffer *buffer) {
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+void ind_buffer_grow(struct ind_buffer *buffer, int n) {
+    int capacity = buffer->capacity < IND_BUFFER_MIN_CAPACITY ? IND_BUFFER_MIN_CAPACITY : buffer->capacity;
+    while (capacity < buffer->size + n)
+        capacity *= 2;
+    buffer->data = (int*) realloc(buffer->data, capacity * sizeof(int));
+    buffer->capacity = capacity;
+#ifdef FIND_STATS
+    find_stats_nb_grows++;
+#endif
+}
+
+// Makes sure that n more indices can be written at buffer->data + buffer->size.
+static inline void ind_buffer_reserve(struct ind_buffer *buffer, int n) {
+    if (buffer->size + n > buffer->capacity)
+        ind_buffer_grow(buffer, n);
+}
+
+// Same as ind_buffer_reserve when the kernel has written nb_find indices so far. Returns the (new) buffer->data.
+static inline int *ind_buffer_reserve_at(struct ind_buffer *buffer, int nb_find, int n) {
+    if (nb_find + n > buffer->capacity) {
+        buffer->size = nb_find;
+        ind_buffer_grow(buffer, n);
+    }
+    return buffer->data;
+}
+
+static inline void ind_buffer_push(struct ind_buffer *buffer, int i) {
+    ind_buffer_reserve(buffer, 1);
+    buffer->data[buffer->size++] = i;
+}
+
+int ind_buffer_release(struct ind_buffer *buffer, int **ind_val) {
+    int nb_find = buffer->size;
+    if (nb_find > 0) {
+        *ind_val = (int*) realloc(buffer->data, nb_find * sizeof(int));
+    } else {
+        free(buffer->data);
+        *ind_val = (int*) malloc(0);
+    }
+    ind_buffer_init(buffer);
+    return nb_find;
+}
+
+void ind_buffer_free(struct ind_buffer *buffer) {
+    free(buffer->data);
+    ind_buffer_init(buffer);
+}
+
+/*
+Early termination
+-----------------
+When only k occurrences are needed (k >= 0), the threads add the number of occurrences that they find to the shared
+counter nb_find with an atomic fetch-add, and the thread that makes it reach k sets stop, so that all the threads stop
+as soon as k occurrences have been found, without any watcher thread polling the counters. To avoid contention on
+nb_find when k is large, each thread only publishes its occurrences once it has found batch new ones. With k < 0, the
+threads never stop.
+stop is read by all the threads for each group of integers, so it is on its own cache line: otherwise, each fetch-add on
+nb_find would invalidate it in the caches of the other threads.
+*/
+
+struct find_limit {
+    _Alignas(CACHE_LINE_SIZE) atomic_int nb_find;
+    _Alignas(CACHE_LINE_SIZE) atomic_bool stop;
+    int k;
+    int batch;
+#ifdef FIND_STATS
+    atomic_long stop_ns;
+#endif
+};
+
+void find_limit_init(struct find_limit *limit, int k, int nb_threads) {
+    atomic_init(&limit->nb_find, 0);
+    atomic_init(&limit->stop, false);
+    limit->k = k;
+    limit->batch = k / (4 * nb_threads) > 1 ? k / (4 * nb_threads) : 1;
+#ifdef FIND_STATS
+    atomic_init(&limit->stop_ns, 0);
+#endif
+}
+
+static inline bool find_limit_stopped(struct find_limit *limit) {
+    return atomic_load_explicit(&limit->stop, memory_order_relaxed);
+}
+
+// Publishes the occurrences found since the last call (nb_find in total, nb_published at the last call).
+static inline void find_limit_publish(struct find_limit *limit, int nb_find, int *nb_published) {
+    int nb_new = nb_find - *nb_published;
+    if (limit->k < 0 || nb_new < limit->batch)
+        return;
+    if (atomic_fetch_add_explicit(&limit->nb_find, nb_new, memory_order_relaxed) + nb_new >= limit->k) {
+#ifdef FIND_STATS
+        long no_stop = 0;
+        atomic_compare_exchange_strong(&limit->stop_ns, &no_stop, get_time_ns());
+#endif
+        atomic_store_explicit(&limit->stop, true, memory_order_relaxed);
+    }
+    *nb_published = nb_find;
+}
+
+/*
+Predicates
+----------
+Besides equality, the kernels can look for the integers that satisfy a predicate: U[i] == val, U[i] != val,
+U[i] < val, U[i] <= val, U[i] > val, U[i] >= val or val <= U[i] <= max (PRED_RANGE).
+Each kernel is written once as a generic function of kind (e.g., avx2_pred_kernel) that is always inlined in one
+specialized kernel for each kind (e.g., avx2_lt_kernel, see PREDICATE_KERNELS), so that kind is a constant and there is
+no test on the kind of predicate in the hot loops. The specialized kernels of each implementation are in an array
+indexed by kind (e.g., avx2_kernels).
+*/
+
+enum predicate_kind { PRED_EQ, PRED_NE, PRED_LT, PRED_LE, PRED_GT, PRED_GE, PRED_RANGE, NB_PREDICATE_KINDS };
+
+struct predicate {
+    enum predicate_kind kind;
+    int val;
+    int max;
+};
+
+struct predicate predicate_eq(int val) {
+    struct predicate pred = {PRED_EQ, val, val};
+    return pred;
+}
+
+static inline __attribute__((always_inline))
+bool predicate_test(enum predicate_kind kind, int x, int val, int max) {
+    switch (kind) {
+        case PRED_EQ: return x == val;
+        case PRED_NE: return x != val;
+        case PRED_LT: return x < val;
+        case PRED_LE: return x <= val;
+        case PRED_GT: return x > val;
+        case PRED_GE: return x >= val;
+        default: return x >= val && x <= max;
+    }
+}
+
+typedef void (*find_kernel_function)(int*, int, int, int, const struct predicate*, struct ind_buffer*,
+                                     struct find_limit*);
+
+// Defines prefix_name_kernel, the kernel specialized for kind, and the array prefix_kernels of all the specialized
+// kernels. target is the target attribute of the kernels, or NO_TARGET for the default target.
+#define NO_TARGET
+#define PREDICATE_KERNEL(prefix, name, kind, target)                                                                \
+    target void prefix##_##name##_kernel(int *U, int i_start, int i_end, int i_step,                                \
+                                         const struct predicate *pred, struct ind_buffer *buffer,                   \
+                                         struct find_limit *limit) {                                                \
+        prefix##_pred_kernel(U, i_start, i_end, i_step, pred, buffer, limit, kind);                                 \
+    }
+
+#define PREDICATE_KERNELS(prefix, target)                                                                           \
+    PREDICATE_KERNEL(prefix, eq, PRED_EQ, target)                                                                   \
+    PREDICATE_KERNEL(prefix, ne, PRED_NE, target)                                                                   \
+    PREDICATE_KERNEL(prefix, lt, PRED_LT, target)                                                                   \
+    PREDICATE_KERNEL(prefix, le, PRED_LE, target)                                                                   \
+    PREDICATE_KERNEL(prefix, gt, PRED_GT, target)                                                                   \
+    PREDICATE_KERNEL(prefix, ge, PRED_GE, target)                                                                   \
+    PREDICATE_KERNEL(prefix, range, PRED_RANGE, target)                                                             \
+    find_kernel_function prefix##_kernels[NB_PREDICATE_KINDS] = {                                                   \
+        prefix##_eq_kernel, prefix##_ne_kernel, prefix##_lt_kernel, prefix##_le_kernel,                             \
+        prefix##_gt_kernel, prefix##_ge_kernel, prefix##_range_kernel                                               \
+    };
+
+/*
+Scalar implementation
+---------------------
+This is the basic implementation, which looks for all occurrences of val within U between indices i_start and i_stop,
+with step i_step, and writes the indices of the occurrences of val in ind_val.
+pred_find does the same for the integers that satisfy pred, with the scalar kernels that are also used by the
+multithreaded implementation.
+*/
+
+int find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val) {
+
+    struct ind_buffer buffer;
+    ind_buffer_init(&buffer);
+
+    for (int i = i_start; i <= i_end; i += i_step)
+        if (U[i] == val)
+            ind_buffer_push(&buffer, i);
+
+    return ind_buffer_release(&buffer, ind_val);
+}
+
+static inline __attribute__((always_inline))
+void scalar_pred_kernel(int *U, int i_start, int i_end, int i_step, const struct predicate *pred,
+                        struct ind_buffer *buffer, struct find_limit *limit, enum predicate_kind kind) {
+
+    int val = pred->val, max = pred->max;
+    int nb_published = buffer->size;
+
+    for (int i = i_start; i <= i_end; i += i_step) {
+        if (find_limit_stopped(limit))
+            break;
+        if (predicate_test(kind, U[i], val, max)) {
+            ind_buffer_push(buffer, i);
+            find_limit_publish(limit, buffer->size, &nb_published);
+        }
+    }
+}
+
+PREDICATE_KERNELS(scalar, NO_TARGET)
+
+int pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, int **ind_val) {
+
+    struct ind_buffer buffer;
+    ind_buffer_init(&buffer);
+    struct find_limit limit;
+    find_limit_init(&limit, -1, 1);
+
+    scalar_kernels[pred.kind](U, i_start, i_end, i_step, &pred, &buffer, &limit);
+
+    return ind_buffer_release(&buffer, ind_val);
+}
+
+/*
+Vector computing implementation
+-------------------------------
+This is the version that makes the most of vector computing.
+i_step must be a multiple of 8.
+Two kernels are available and the best one is chosen at runtime depending on the instruction sets of the processor:
+- avx2_eq_kernel compares integer vectors with _mm256_cmpeq_epi32 and works for any value,
+- avx_eq_kernel compares the two halves of each group of 8 integers with _mm_cmpeq_epi32, so that it can run on
+  processors that only support AVX, and also works for any value.
+The kernels append the indices of the occurrences of val to buffer, so that they can be shared with the multithreaded
+implementation, and return as soon as limit is reached (see find_limit).
+vect_pred_find does the same for the integers that satisfy pred. The AVX2 kernels use _mm256_cmpgt_epi32 for the
+order comparisons and the AVX kernels compare the two halves of each group of 8 integers with 128-bit integer vectors,
+as for equality.
+
+On processors that support AVX-512, vect512_find works with 16 integers at a time (i_step must then be a multiple of 16)
+and writes the indices of the occurrences directly with _mm512_mask_compressstoreu_epi32 instead of looping over the
+bits of the mask.
+
+When the groups are contiguous (i_step equals 8, or 16 for AVX-512), the AVX2 and AVX-512 kernels compare FIND_UNROLL
+independent groups in each iteration, and only look at their masks if one of them is not zero, which is the common case
+when matches are rare. They also prefetch the integers that are FIND_PREFETCH_DISTANCE integers ahead (0 to disable),
+both of which can be tuned at compile time (-DFIND_UNROLL=... and -DFIND_PREFETCH_DISTANCE=...).
+The AVX and AVX2 kernels write the indices of the occurrences of a group without looping over the bits of its mask: the
+positions of the ones of the mask are read in permutation_table and added to the index of the group, and all 8
+resulting integers are written with a single store, after which the number of indices only moves by the number of ones.
+*/
+
+#ifndef FIND_PREFETCH_DISTANCE
+#define FIND_PREFETCH_DISTANCE 1024
+#endif
+#ifndef FIND_UNROLL
+#define FIND_UNROLL 4
+#endif
+
+// Returns the 8-bit mask of the lanes of the 128-bit comparisons lo and hi.
+#define MASK_128(lo, hi) (_mm_movemask_ps(_mm_castsi128_ps(lo)) | _mm_movemask_ps(_mm_castsi128_ps(hi)) << 4)
+
+// Writes i + the position of each bit of mask from data[nb_find] and returns the new number of indices.
+static inline __attribute__((always_inline))
+int emit_mask_indices(int *data, int nb_find, int i, unsigned int mask) {
+    for (; mask != 0; mask &= mask - 1)
+        data[nb_find++] = i + __builtin_ctz(mask);
+    return nb_find;
+}
+
+// Same as emit_mask_indices, but without any loop: each half of the group is written with a single store of the 4
+// indices given by half_permutation_table, and the number of indices only moves by the number of ones. The stores
+// write up to 8 integers, so the loop is used if the buffer cannot hold 8 more integers.
+static inline __attribute__((always_inline))
+int avx_emit_mask_indices(int *data, int nb_find, int capacity, int i, int mask) {
+    if (capacity - nb_find < 8)
+        return emit_mask_indices(data, nb_find, i, mask);
+    _mm_storeu_si128((__m128i*) (data + nb_find),
+                     _mm_add_epi32(_mm_set1_epi32(i), _mm_loadu_si128((__m128i*) half_permutation_table[mask & 0xF])));
+    nb_find += count_ones_table[mask & 0xF];
+    _mm_storeu_si128((__m128i*) (data + nb_find),
+                     _mm_add_epi32(_mm_set1_epi32(i + 4), _mm_loadu_si128((__m128i*) half_permutation_table[mask >> 4])));
+    return nb_find + count_ones_table[mask >> 4];
+}
+
+// Returns the mask of the integers of the group of 8 integers lo, hi (its two halves) that satisfy the predicate.
+static inline __attribute__((always_inline))
+int avx_halves_mask(__m128i lo, __m128i hi, __m128i vect_val, __m128i vect_max, enum predicate_kind kind) {
+    switch (kind) {
+        case PRED_EQ: return MASK_128(_mm_cmpeq_epi32(lo, vect_val), _mm_cmpeq_epi32(hi, vect_val));
+        case PRED_NE: return MASK_128(_mm_cmpeq_epi32(lo, vect_val), _mm_cmpeq_epi32(hi, vect_val)) ^ 0xFF;
+        case PRED_LT: return MASK_128(_mm_cmplt_epi32(lo, vect_val), _mm_cmplt_epi32(hi, vect_val));
+        case PRED_LE: return MASK_128(_mm_cmpgt_epi32(lo, vect_val), _mm_cmpgt_epi32(hi, vect_val)) ^ 0xFF;
+        case PRED_GT: return MASK_128(_mm_cmpgt_epi32(lo, vect_val), _mm_cmpgt_epi32(hi, vect_val));
+        case PRED_GE: return MASK_128(_mm_cmplt_epi32(lo, vect_val), _mm_cmplt_epi32(hi, vect_val)) ^ 0xFF;
+        default: return MASK_128(_mm_or_si128(_mm_cmplt_epi32(lo, vect_val), _mm_cmpgt_epi32(lo, vect_max)),
+                                 _mm_or_si128(_mm_cmplt_epi32(hi, vect_val), _mm_cmpgt_epi32(hi, vect_max))) ^ 0xFF;
+    }
+}
+
+// Returns the mask of the integers of the group of 8 integers at p that satisfy the predicate.
+static inline __attribute__((always_inline))
+int avx_predicate_mask(int *p, __m128i vect_val, __m128i vect_max, enum predicate_kind kind) {
+    return avx_halves_mask(_mm_loadu_si128((__m128i*) p), _mm_loadu_si128((__m128i*) (p + 4)), vect_val, vect_max,
+                           kind);
+}
+
+// Returns the mask of the first n (at most 8) integers at p that satisfy the predicate, without reading the others.
+static inline __attribute__((always_inline))
+int avx_partial_mask(int *p, int n, __m128i vect_val, __m128i vect_max, enum predicate_kind kind) {
+    __m128i lanes_lo = _mm_cmpgt_epi32(_mm_set1_epi32(n), _mm_setr_epi32(0, 1, 2, 3));
+    __m128i lanes_hi = _mm_cmpgt_epi32(_mm_set1_epi32(n), _mm_setr_epi32(4, 5, 6, 7));
+    return avx_halves_mask(_mm_castps_si128(_mm_maskload_ps((float*) p, lanes_lo)),
+                           _mm_castps_si128(_mm_maskload_ps((float*) (p + 4), lanes_hi)), vect_val, vect_max, kind) &
+           ((1 << n) - 1);
+}
+
+static inline __attribute__((always_inline))
+void avx_pred_kernel(int *U, int i_start, int i_end, int i_step, const struct predicate *pred,
+                     struct ind_buffer *buffer, struct find_limit *limit, enum predicate_kind kind) {
+
+    int val = pred->val, max = pred->max;
+    __m128i vect_val = _mm_set1_epi32(val);
+    __m128i vect_max = _mm_set1_epi32(max);
+
+    int *data = buffer->data;
+    int nb_find = buffer->size;
+    int i = i_start, mask, nb_published = nb_find;
+
+    // Contiguous groups: peel the integers before the first 32-byte boundary, so that the groups below are aligned
+    if (i_step == 8) {
+        int head = (int) ((32 - (uintptr_t) (U + i) % 32) % 32 / sizeof(int));
+        if (head > 0 && i + head <= i_end) {
+            mask = avx_partial_mask(U + i, head, vect_val, vect_max, kind);
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+                nb_find = avx_emit_mask_indices(data, nb_find, buffer->capacity, i, mask);
+            }
+            i += head;
+        }
+
+        for (; i + 8 < i_end; i += 8) {
+            if (find_limit_stopped(limit))
+                break;
+            mask = avx_halves_mask(_mm_load_si128((__m128i*) (U + i)), _mm_load_si128((__m128i*) (U + i + 4)),
+                                   vect_val, vect_max, kind);
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+                nb_find = avx_emit_mask_indices(data, nb_find, buffer->capacity, i, mask);
+                find_limit_publish(limit, nb_find, &nb_published);
+            }
+        }
+    }
+
+    for (; i + 8 < i_end; i += i_step) {
+        if (find_limit_stopped(limit))
+            break;
+        mask = avx_predicate_mask(U + i, vect_val, vect_max, kind);
+        if (mask) {
+            data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+            nb_find = avx_emit_mask_indices(data, nb_find, buffer->capacity, i, mask);
+            find_limit_publish(limit, nb_find, &nb_published);
+        }
+    }
+
+    // Unless the search stopped early, compare the last integers with masked loads
+    if (i + 8 >= i_end) {
+        for (; i <= i_end; i += 8) {
+            mask = avx_partial_mask(U + i, i_end - i + 1 < 8 ? i_end - i + 1 : 8, vect_val, vect_max, kind);
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+                nb_find = avx_emit_mask_indices(data, nb_find, buffer->capacity, i, mask);
+            }
+        }
+    }
+    buffer->size = nb_find;
+}
+
+PREDICATE_KERNELS(avx, NO_TARGET)
+
+__attribute__((target("avx2"))) static inline __attribute__((always_inline))
+int avx2_predicate_mask(__m256i x, __m256i vect_val, __m256i vect_max, enum predicate_kind kind) {
+    switch (kind) {
+        case PRED_EQ: return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, vect_val)));
+        case PRED_NE: return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, vect_val))) ^ 0xFF;
+        case PRED_LT: return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vect_val, x)));
+        case PRED_LE: return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, vect_val))) ^ 0xFF;
+        case PRED_GT: return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, vect_val)));
+        case PRED_GE: return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vect_val, x))) ^ 0xFF;
+        default: return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpgt_epi32(vect_val, x),
+                                                                                _mm256_cmpgt_epi32(x, vect_max)))) ^ 0xFF;
+    }
+}
+
+// Same as avx_emit_mask_indices, with a single store of the 8 indices given by permutation_table.
+__attribute__((target("avx2"))) static inline __attribute__((always_inline))
+int avx2_emit_mask_indices(int *data, int nb_find, int capacity, int i, int mask) {
+    if (capacity - nb_find < 8)
+        return emit_mask_indices(data, nb_find, i, mask);
+    __m256i positions = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(permutation_table[mask]),
+                                                           _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28)),
+                                         _mm256_set1_epi32(0xF));
+    _mm256_storeu_si256((__m256i*) (data + nb_find), _mm256_add_epi32(_mm256_set1_epi32(i), positions));
+    return nb_find + count_ones_table[mask];
+}
+
+// Returns the mask of the first n (at most 8) integers at p that satisfy the predicate, without reading the others.
+__attribute__((target("avx2"))) static inline __attribute__((always_inline))
+int avx2_partial_mask(int *p, int n, __m256i vect_val, __m256i vect_max, enum predicate_kind kind) {
+    __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    return avx2_predicate_mask(_mm256_maskload_epi32(p, lanes), vect_val, vect_max, kind) & ((1 << n) - 1);
+}
+
+__attribute__((target("avx2"))) static inline __attribute__((always_inline))
+void avx2_pred_kernel(int *U, int i_start, int i_end, int i_step, const struct predicate *pred,
+                      struct ind_buffer *buffer, struct find_limit *limit, enum predicate_kind kind) {
+
+    int val = pred->val, max = pred->max;
+    __m256i vect_val = _mm256_set1_epi32(val);
+    __m256i vect_max = _mm256_set1_epi32(max);
+
+    int *data = buffer->data;
+    int nb_find = buffer->size;
+    int i = i_start, mask, nb_published = nb_find;
+
+    // Contiguous groups: FIND_UNROLL groups at a time, with a single test when none of them matches
+    if (i_step == 8) {
+
+        // Peel the integers before the first 32-byte boundary, so that the groups below are aligned
+        int head = (int) ((32 - (uintptr_t) (U + i) % 32) % 32 / sizeof(int));
+        if (head > 0 && i + head <= i_end) {
+            mask = avx2_partial_mask(U + i, head, vect_val, vect_max, kind);
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+                nb_find = avx2_emit_mask_indices(data, nb_find, buffer->capacity, i, mask);
+            }
+            i += head;
+        }
+
+        for (; i + 8 * FIND_UNROLL < i_end; i += 8 * FIND_UNROLL) {
+            if (find_limit_stopped(limit))
+                break;
+            for (int l = 0; FIND_PREFETCH_DISTANCE > 0 && l < 8 * FIND_UNROLL; l += CACHE_LINE_SIZE / sizeof(int))
+                _mm_prefetch((const char*) (U + i + FIND_PREFETCH_DISTANCE + l), _MM_HINT_T0);
+            int masks[FIND_UNROLL], any = 0;
+            for (int g = 0; g < FIND_UNROLL; g++) {
+                masks[g] = avx2_predicate_mask(_mm256_load_si256((__m256i*) (U + i + 8 * g)), vect_val, vect_max,
+                                               kind);
+                any |= masks[g];
+            }
+            if (!any)
+                continue;
+            for (int g = 0; g < FIND_UNROLL; g++) {
+                if (masks[g]) {
+                    data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[masks[g]]);
+                    nb_find = avx2_emit_mask_indices(data, nb_find, buffer->capacity, i + 8 * g, masks[g]);
+                }
+            }
+            find_limit_publish(limit, nb_find, &nb_published);
+        }
+    }
+
+    for (; i + 8 < i_end; i += i_step) {
+        if (find_limit_stopped(limit))
+            break;
+        mask = avx2_predicate_mask(_mm256_loadu_si256((__m256i*) (U + i)), vect_val, vect_max, kind);
+        if (mask) {
+            data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+            nb_find = avx2_emit_mask_indices(data, nb_find, buffer->capacity, i, mask);
+            find_limit_publish(limit, nb_find, &nb_published);
+        }
+    }
+
+    // Unless the search stopped early, compare the last integers with masked loads
+    if (i + 8 >= i_end) {
+        for (; i <= i_end; i += 8) {
+            mask = avx2_partial_mask(U + i, i_end - i + 1 < 8 ? i_end - i + 1 : 8, vect_val, vect_max, kind);
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+                nb_find = avx2_emit_mask_indices(data, nb_find, buffer->capacity, i, mask);
+            }
+        }
+    }
+    buffer->size = nb_find;
+}
+
+PREDICATE_KERNELS(avx2, __attribute__((target("avx2"))))
+
+__attribute__((target("avx512f,popcnt"))) static inline __attribute__((always_inline))
+__mmask16 avx512_predicate_mask(__m512i x, __m512i vect_val, __m512i vect_max, enum predicate_kind kind) {
+    switch (kind) {
+        case PRED_EQ: return _mm512_cmp_epi32_mask(x, vect_val, _MM_CMPINT_EQ);
+        case PRED_NE: return _mm512_cmp_epi32_mask(x, vect_val, _MM_CMPINT_NE);
+        case PRED_LT: return _mm512_cmp_epi32_mask(x, vect_val, _MM_CMPINT_LT);
+        case PRED_LE: return _mm512_cmp_epi32_mask(x, vect_val, _MM_CMPINT_LE);
+        case PRED_GT: return _mm512_cmp_epi32_mask(x, vect_val, _MM_CMPINT_NLE);
+        case PRED_GE: return _mm512_cmp_epi32_mask(x, vect_val, _MM_CMPINT_NLT);
+        default: return _mm512_mask_cmp_epi32_mask(_mm512_cmp_epi32_mask(x, vect_val, _MM_CMPINT_NLT), x, vect_max,
+                                                   _MM_CMPINT_LE);
+    }
+}
+
+// Writes i + the position of each bit of mask from data[nb_find] and returns the new number of indices.
+__attribute__((target("avx512f,popcnt"))) static inline __attribute__((always_inline))
+int avx512_emit_mask_indices(int *data, int nb_find, int i, __mmask16 mask, __m512i vect_offsets) {
+    _mm512_mask_compressstoreu_epi32(data + nb_find, mask, _mm512_add_epi32(_mm512_set1_epi32(i), vect_offsets));
+    return nb_find + _mm_popcnt_u32(mask);
+}
+
+__attribute__((target("avx512f,popcnt"))) static inline __attribute__((always_inline))
+void avx512_pred_kernel(int *U, int i_start, int i_end, int i_step, const struct predicate *pred,
+                        struct ind_buffer *buffer, struct find_limit *limit, enum predicate_kind kind) {
+
+    int val = pred->val, max = pred->max;
+    __m512i vect_val = _mm512_set1_epi32(val);
+    __m512i vect_max = _mm512_set1_epi32(max);
+    __m512i vect_offsets = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    int *data = buffer->data;
+    int nb_find = buffer->size;
+    int i = i_start, nb_published = nb_find;
+    __mmask16 mask;
+
+    // Contiguous groups: FIND_UNROLL groups at a time, with a single test when none of them matches
+    if (i_step == 16) {
+
+        // Peel the integers before the first cache line boundary, so that the groups below are aligned
+        int head = (int) ((64 - (uintptr_t) (U + i) % 64) % 64 / sizeof(int));
+        if (head > 0 && i + head <= i_end) {
+            __mmask16 lanes = (__mmask16) ((1 << head) - 1);
+            mask = avx512_predicate_mask(_mm512_maskz_loadu_epi32(lanes, U + i), vect_val, vect_max, kind) & lanes;
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, _mm_popcnt_u32(mask));
+                nb_find = avx512_emit_mask_indices(data, nb_find, i, mask, vect_offsets);
+            }
+            i += head;
+        }
+
+        for (; i + 16 * FIND_UNROLL < i_end; i += 16 * FIND_UNROLL) {
+            if (find_limit_stopped(limit))
+                break;
+            for (int l = 0; FIND_PREFETCH_DISTANCE > 0 && l < 16 * FIND_UNROLL; l += CACHE_LINE_SIZE / sizeof(int))
+                _mm_prefetch((const char*) (U + i + FIND_PREFETCH_DISTANCE + l), _MM_HINT_T0);
+            __mmask16 masks[FIND_UNROLL];
+            int any = 0;
+            for (int g = 0; g < FIND_UNROLL; g++) {
+                masks[g] = avx512_predicate_mask(_mm512_load_si512(U + i + 16 * g), vect_val, vect_max, kind);
+                any |= masks[g];
+            }
+            if (!any)
+                continue;
+            for (int g = 0; g < FIND_UNROLL; g++) {
+                if (masks[g]) {
+                    data = ind_buffer_reserve_at(buffer, nb_find, _mm_popcnt_u32(masks[g]));
+                    nb_find = avx512_emit_mask_indices(data, nb_find, i + 16 * g, masks[g], vect_offsets);
+                }
+            }
+            find_limit_publish(limit, nb_find, &nb_published);
+        }
+    }
+
+    for (; i + 16 < i_end; i += i_step) {
+        if (find_limit_stopped(limit))
+            break;
+        mask = avx512_predicate_mask(_mm512_loadu_si512(U + i), vect_val, vect_max, kind);
+        if (mask) {
+            data = ind_buffer_reserve_at(buffer, nb_find, _mm_popcnt_u32(mask));
+            nb_find = avx512_emit_mask_indices(data, nb_find, i, mask, vect_offsets);
+            find_limit_publish(limit, nb_find, &nb_published);
+        }
+    }
+
+    // Unless the search stopped early, compare the last integers with a masked load
+    if (i + 16 >= i_end) {
+        for (; i <= i_end; i += 16) {
+            int n = i_end - i + 1 < 16 ? i_end - i + 1 : 16;
+            __mmask16 lanes = (__mmask16) ((1 << n) - 1);
+            mask = avx512_predicate_mask(_mm512_maskz_loadu_epi32(lanes, U + i), vect_val, vect_max, kind) & lanes;
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, _mm_popcnt_u32(mask));
+                nb_find = avx512_emit_mask_indices(data, nb_find, i, mask, vect_offsets);
+            }
+        }
+    }
+    buffer->size = nb_find;
+}
+
+PREDICATE_KERNELS(avx512, __attribute__((target("avx512f,popcnt"))))
+
+// Returns the most efficient kernel for kind that the processor supports.
+find_kernel_function get_vect_kernel(enum predicate_kind kind) {
+    if (__builtin_cpu_supports("avx2"))
+        return avx2_kernels[kind];
+    return avx_kernels[kind];
+}
+
+int vect_pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, int **ind_val) {
+
+    if (i_step % 8 != 0)
+        return -1;
+
+    struct ind_buffer buffer;
+    ind_buffer_init(&buffer);
+    struct find_limit limit;
+    find_limit_init(&limit, -1, 1);
+
+    get_vect_kernel(pred.kind)(U, i_start, i_end, i_step, &pred, &buffer, &limit);
+
+    return ind_buffer_release(&buffer, ind_val);
+}
+
+int vect_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val) {
+    return vect_pred_find(U, i_start, i_end, i_step, predicate_eq(val), ind_val);
+}
+
+bool avx512_supported() {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt");
+}
+
+int vect512_pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, int **ind_val) {
+
+    if (i_step % 16 != 0 || !avx512_supported())
+        return -1;
+
+    struct ind_buffer buffer;
+    ind_buffer_init(&buffer);
+    struct find_limit limit;
+    find_limit_init(&limit, -1, 1);
+
+    avx512_kernels[pred.kind](U, i_start, i_end, i_step, &pred, &buffer, &limit);
+
+    return ind_buffer_release(&buffer, ind_val);
+}
+
+int vect512_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val) {
+    return vect512_pred_find(U, i_start, i_end, i_step, predicate_eq(val), ind_val);
+}
+
+/*
+Strided vector computing implementation
+---------------------------------------
+The vector computing kernels compare the groups of 8 (or 16) consecutive integers that start at i_start, i_start +
+i_step..., which is the whole range when i_step equals 8. strided_pred_find (and strided_find for val) returns the same
+indices as pred_find (and find) instead, for any i_step, e.g., to search one column of an array of structures: only the
+integers U[i_start + j * i_step] are compared.
+- When i_step equals 1, it is the contiguous AVX2 kernel with groups of 8 integers.
+- When i_step is at most FIND_DEINTERLEAVE_MAX_STEP, the 8 * i_step consecutive integers that contain 8 steps are read
+  anyway (they are in the same cache lines), so they are all compared with regular loads and only the bits of the
+  integers of the steps are kept in their mask (bits 0, i_step, 2 * i_step...), which must fit in 32 bits.
+- Otherwise, the integers of 8 steps are loaded with _mm256_i32gather_epi32, and the positions of the ones of their
+  mask (from permutation_table) are multiplied by i_step and added to the index of the first step.
+The last steps (fewer than 8) are compared one by one. On processors that do not support AVX2, the scalar kernels are
+used. In thread_pred_find and the other multithreaded versions, ver 3 selects these kernels.
 */
 
-int* generate_U(int nb_items, int min_val, int max_val) {
-    int *U = (int*) aligned_alloc(CACHE_LINE_SIZE, nb_items * sizeof(int));
-    for (int i = 0; i < nb_items; i++)
-        U[i] = rand() % (max_val - min_val + 1) + min_val;
-    return U;
+#define FIND_DEINTERLEAVE_MAX_STEP 4
+
+// Same as avx2_emit_mask_indices for the 8 integers at i, i + i_step, ..., i + 7 * i_step.
+__attribute__((target("avx2"))) static inline __attribute__((always_inline))
+int avx2_emit_strided_mask_indices(int *data, int nb_find, int capacity, int i, int i_step, int mask) {
+    if (capacity - nb_find < 8) {
+        for (; mask != 0; mask &= mask - 1)
+            data[nb_find++] = i + __builtin_ctz(mask) * i_step;
+        return nb_find;
+    }
+    __m256i positions = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(permutation_table[mask]),
+                                                           _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28)),
+                                         _mm256_set1_epi32(0xF));
+    positions = _mm256_mullo_epi32(positions, _mm256_set1_epi32(i_step));
+    _mm256_storeu_si256((__m256i*) (data + nb_find), _mm256_add_epi32(_mm256_set1_epi32(i), positions));
+    return nb_find + count_ones_table[mask];
+}
+
+__attribute__((target("avx2"))) static inline __attribute__((always_inline))
+void avx2_strided_pred_kernel(int *U, int i_start, int i_end, int i_step, const struct predicate *pred,
+                              struct ind_buffer *buffer, struct find_limit *limit, enum predicate_kind kind) {
+
+    if (i_step == 1) {
+        avx2_pred_kernel(U, i_start, i_end, 8, pred, buffer, limit, kind);
+        return;
+    }
+
+    int val = pred->val, max = pred->max;
+    __m256i vect_val = _mm256_set1_epi32(val);
+    __m256i vect_max = _mm256_set1_epi32(max);
+
+    int *data = buffer->data;
+    int nb_find = buffer->size;
+    int i = i_start, nb_published = nb_find;
+
+    if (i_step <= FIND_DEINTERLEAVE_MAX_STEP) {
+        unsigned int steps = 0;
+        for (int l = 0; l < 8; l++)
+            steps |= 1u << (l * i_step);
+        for (; (long) i + 8 * i_step - 1 <= i_end; i += 8 * i_step) {
+            if (find_limit_stopped(limit))
+                break;
+            unsigned int mask = 0;
+            for (int v = 0; v < i_step; v++)
+                mask |= (unsigned int) avx2_predicate_mask(_mm256_loadu_si256((__m256i*) (U + i + 8 * v)), vect_val,
+                                                           vect_max, kind) << (8 * v);
+            mask &= steps;
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, __builtin_popcount(mask));
+                nb_find = emit_mask_indices(data, nb_find, i, mask);
+                find_limit_publish(limit, nb_find, &nb_published);
+            }
+        }
+    } else if (i_step <= INT_MAX / 8) {
+        __m256i vect_offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(i_step));
+        for (; (long) i + 7L * i_step <= i_end; i += 8 * i_step) {
+            if (find_limit_stopped(limit))
+                break;
+            int mask = avx2_predicate_mask(_mm256_i32gather_epi32(U + i, vect_offsets, 4), vect_val, vect_max, kind);
+            if (mask) {
+                data = ind_buffer_reserve_at(buffer, nb_find, count_ones_table[mask]);
+                nb_find = avx2_emit_strided_mask_indices(data, nb_find, buffer->capacity, i, i_step, mask);
+                find_limit_publish(limit, nb_find, &nb_published);
+            }
+        }
+    }
+    buffer->size = nb_find;
+
+    // Unless the search stopped early, compare the last steps one by one
+    if (!find_limit_stopped(limit))
+        for (; i <= i_end; i += i_step)
+            if (predicate_test(kind, U[i], val, max))
+                ind_buffer_push(buffer, i);
+}
+
+PREDICATE_KERNELS(avx2_strided, __attribute__((target("avx2"))))
+
+// Returns the kernel for kind that honors any step and that the processor supports.
+find_kernel_function get_strided_kernel(enum predicate_kind kind) {
+    if (__builtin_cpu_supports("avx2"))
+        return avx2_strided_kernels[kind];
+    return scalar_kernels[kind];
+}
+
+int strided_pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, int **ind_val) {
+
+    struct ind_buffer buffer;
+    ind_buffer_init(&buffer);
+    struct find_limit limit;
+    find_limit_init(&limit, -1, 1);
+
+    get_strided_kernel(pred.kind)(U, i_start, i_end, i_step, &pred, &buffer, &limit);
+
+    return ind_buffer_release(&buffer, ind_val);
+}
+
+int strided_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val) {
+    return strided_pred_find(U, i_start, i_end, i_step, predicate_eq(val), ind_val);
+}
+
+/*
+Counting implementation
+-----------------------
+count_only returns the number of occurrences of val within U between indices i_start and i_end, with step i_step, as
+find does, but without writing any index. When i_step equals 1, it uses the most efficient vector computing kernel,
+which adds up the number of ones in the mask of each group of integers.
+The count kernels have the same arguments as the vector computing kernels (i_step must be a multiple of 8, or 16 for
+avx512_count_kernel) and scalar_count_kernel honors any step, so that they can be shared with the multithreaded
+implementation.
+*/
+
+typedef int (*count_kernel_function)(int*, int, int, int, int);
+
+int scalar_count_kernel(int *U, int i_start, int i_end, int i_step, int val) {
+
+    int nb_find = 0;
+
+    for (int i = i_start; i <= i_end; i += i_step)
+        nb_find += U[i] == val;
+
+    return nb_find;
+}
+
+int avx_count_kernel(int *U, int i_start, int i_end, int i_step, int val) {
+
+    __m128i vect_val = _mm_set1_epi32(val);
+    int nb_find = 0;
+    int i = i_start;
+
+    // Contiguous groups: peel the integers before the first 32-byte boundary, so that the groups below are aligned
+    if (i_step == 8) {
+        int head = (int) ((32 - (uintptr_t) (U + i) % 32) % 32 / sizeof(int));
+        if (head > 0 && i + head <= i_end) {
+            nb_find += count_ones_table[avx_partial_mask(U + i, head, vect_val, vect_val, PRED_EQ)];
+            i += head;
+        }
+        for (; i + 8 < i_end; i += 8)
+            nb_find += count_ones_table[avx_halves_mask(_mm_load_si128((__m128i*) (U + i)),
+                                                        _mm_load_si128((__m128i*) (U + i + 4)), vect_val, vect_val,
+                                                        PRED_EQ)];
+    }
+
+    for (; i + 8 < i_end; i += i_step)
+        nb_find += count_ones_table[avx_predicate_mask(U + i, vect_val, vect_val, PRED_EQ)];
+
+    // Compare the last integers with masked loads
+    for (; i <= i_end; i += 8)
+        nb_find += count_ones_table[avx_partial_mask(U + i, i_end - i + 1 < 8 ? i_end - i + 1 : 8, vect_val, vect_val,
+                                                     PRED_EQ)];
+
+    return nb_find;
+}
+
+__attribute__((target("avx2,popcnt")))
+int avx2_count_kernel(int *U, int i_start, int i_end, int i_step, int val) {
+
+    __m256i vect_val = _mm256_set1_epi32(val);
+    int nb_find = 0;
+    int i = i_start;
+
+    // Contiguous groups: peel the integers before the first 32-byte boundary, so that the groups below are aligned
+    if (i_step == 8) {
+        int head = (int) ((32 - (uintptr_t) (U + i) % 32) % 32 / sizeof(int));
+        if (head > 0 && i + head <= i_end) {
+            nb_find += _mm_popcnt_u32(avx2_partial_mask(U + i, head, vect_val, vect_val, PRED_EQ));
+            i += head;
+        }
+        for (; i + 8 < i_end; i += 8)
+            nb_find += _mm_popcnt_u32(_mm256_movemask_ps(_mm256_castsi256_ps(
+                _mm256_cmpeq_epi32(_mm256_load_si256((__m256i*) (U + i)), vect_val))));
+    }
+
+    for (; i + 8 < i_end; i += i_step)
+        nb_find += _mm_popcnt_u32(_mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i*) (U + i)), vect_val))));
+
+    // Compare the last integers with masked loads
+    for (; i <= i_end; i += 8)
+        nb_find += _mm_popcnt_u32(avx2_partial_mask(U + i, i_end - i + 1 < 8 ? i_end - i + 1 : 8, vect_val, vect_val,
+                                                    PRED_EQ));
+
+    return nb_find;
+}
+
+__attribute__((target("avx512f,popcnt")))
+int avx512_count_kernel(int *U, int i_start, int i_end, int i_step, int val) {
+
+    __m512i vect_val = _mm512_set1_epi32(val);
+    int nb_find = 0;
+    int i = i_start;
+
+    // Contiguous groups: peel the integers before the first cache line boundary, so that the groups below are aligned
+    if (i_step == 16) {
+        int head = (int) ((64 - (uintptr_t) (U + i) % 64) % 64 / sizeof(int));
+        if (head > 0 && i + head <= i_end) {
+            __mmask16 lanes = (__mmask16) ((1 << head) - 1);
+            nb_find += _mm_popcnt_u32(_mm512_mask_cmpeq_epi32_mask(lanes, _mm512_maskz_loadu_epi32(lanes, U + i),
+                                                                   vect_val));
+            i += head;
+        }
+        for (; i + 16 < i_end; i += 16)
+            nb_find += _mm_popcnt_u32(_mm512_cmpeq_epi32_mask(_mm512_load_si512(U + i), vect_val));
+    }
+
+    for (; i + 16 < i_end; i += i_step)
+        nb_find += _mm_popcnt_u32(_mm512_cmpeq_epi32_mask(_mm512_loadu_si512(U + i), vect_val));
+
+    // Compare the last integers with a masked load
+    for (; i <= i_end; i += 16) {
+        int n = i_end - i + 1 < 16 ? i_end - i + 1 : 16;
+        __mmask16 lanes = (__mmask16) ((1 << n) - 1);
+        nb_find += _mm_popcnt_u32(_mm512_mask_cmpeq_epi32_mask(lanes, _mm512_maskz_loadu_epi32(lanes, U + i),
+                                                               vect_val));
+    }
+
+    return nb_find;
+}
+
+// Returns the most efficient count kernel that the processor supports.
+count_kernel_function get_count_kernel() {
+    if (avx512_supported())
+        return avx512_count_kernel;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return avx2_count_kernel;
+    return avx_count_kernel;
+}
+
+int count_only(int *U, int i_start, int i_end, int i_step, int val) {
+
+    if (i_step != 1)
+        return scalar_count_kernel(U, i_start, i_end, i_step, val);
+
+    count_kernel_function count_kernel = get_count_kernel();
+    return count_kernel(U, i_start, i_end, count_kernel == avx512_count_kernel ? 16 : 8, val);
+}
+
+/*
+Thread pool
+-----------
+Creating and joining the threads on each call costs more than the search itself for small arrays. Instead, the
+workers of a thread_pool are created once, by thread_pool_create, and each one is pinned to one of the cores of
+affinity (by default, the cores that the process is allowed to run on). There are nb_threads workers, or one for each
+of those cores if nb_threads <= 0. They wait on submit_cond until tasks are submitted.
+thread_pool_submit submits nb_tasks tasks, so that task i runs function(args + i * arg_size), and returns immediately.
+Task i always runs on worker i % nb_threads: when the same chunks of an array are given to the same tasks, each chunk is
+always read by the same core, which is the one that first touched its pages (see alloc_U) on NUMA machines.
+thread_pool_wait waits for all the submitted tasks to be done. Only one batch of tasks runs at a time: if another
+thread has submitted a batch that it has not waited for yet, thread_pool_submit first waits for it to be done, so that
+several threads can share a pool (their batches run one after the other, see find_ctx to run them concurrently).
+*/
+
+struct thread_pool_worker {
+    pthread_t thread;
+    struct thread_pool *pool;
+    int id;
+};
+
+struct thread_pool {
+    struct thread_pool_worker *workers;
+    int nb_threads;
+    cpu_set_t affinity;
+    pthread_mutex_t mutex;
+    pthread_cond_t submit_cond;
+    pthread_cond_t done_cond;
+    void *(*function)(void*);
+    char *args;
+    size_t arg_size;
+    int nb_tasks;
+    int nb_done;
+    int generation;
+    bool submitted;
+    pthread_cond_t idle_cond;
+    bool shutdown;
+};
+
+// Pins the calling thread to the n-th core (modulo the number of cores) of affinity.
+void pin_thread(const cpu_set_t *affinity, int n) {
+    cpu_set_t cpu;
+    n %= CPU_COUNT(affinity);
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, affinity) && n-- == 0) {
+            CPU_ZERO(&cpu);
+            CPU_SET(c, &cpu);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu);
+            return;
+        }
+}
+
+void *thread_pool_worker_function(void* thread_arg) {
+
+    struct thread_pool_worker *worker = (struct thread_pool_worker*) thread_arg;
+    struct thread_pool *pool = worker->pool;
+
+    pin_thread(&pool->affinity, worker->id);
+
+    int generation = 0;
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (!pool->shutdown && pool->generation == generation)
+            pthread_cond_wait(&pool->submit_cond, &pool->mutex);
+        if (pool->shutdown)
+            break;
+        generation = pool->generation;
+        void *(*function)(void*) = pool->function;
+        char *args = pool->args;
+        size_t arg_size = pool->arg_size;
+        int nb_tasks = pool->nb_tasks;
+        pthread_mutex_unlock(&pool->mutex);
+
+        int nb_done = 0;
+        for (int task = worker->id; task < nb_tasks; task += pool->nb_threads) {
+            function(args + task * arg_size);
+            nb_done++;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->nb_done += nb_done;
+        if (pool->nb_done == pool->nb_tasks)
+            pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+#ifdef FIND_STATS
+    find_stats_close_counters();
+#endif
+    return NULL;
+}
+
+struct thread_pool *thread_pool_create(int nb_threads, const cpu_set_t *affinity) {
+
+    struct thread_pool *pool = (struct thread_pool*) calloc(1, sizeof(struct thread_pool));
+
+    if (affinity != NULL && CPU_COUNT(affinity) > 0)
+        pool->affinity = *affinity;
+    else if (sched_getaffinity(0, sizeof(cpu_set_t), &pool->affinity) != 0 || CPU_COUNT(&pool->affinity) == 0) {
+        CPU_ZERO(&pool->affinity);
+        CPU_SET(0, &pool->affinity);
+    }
+    pool->nb_threads = nb_threads > 0 ? nb_threads : CPU_COUNT(&pool->affinity);
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->submit_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+
+    pool->workers = (struct thread_pool_worker*) malloc(pool->nb_threads * sizeof(struct thread_pool_worker));
+    for (int t = 0; t < pool->nb_threads; t++) {
+        pool->workers[t].pool = pool;
+        pool->workers[t].id = t;
+        pthread_create(&pool->workers[t].thread, NULL, thread_pool_worker_function, &pool->workers[t]);
+    }
+
+    return pool;
+}
+
+void thread_pool_destroy(struct thread_pool *pool) {
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->submit_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int t = 0; t < pool->nb_threads; t++)
+        pthread_join(pool->workers[t].thread, NULL);
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->submit_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->workers);
+    free(pool);
+}
+
+void thread_pool_submit(struct thread_pool *pool, void *(*function)(void*), void *args, size_t arg_size, int nb_tasks) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->submitted)
+        pthread_cond_wait(&pool->idle_cond, &pool->mutex);
+    pool->submitted = true;
+    pool->function = function;
+    pool->args = (char*) args;
+    pool->arg_size = arg_size;
+    pool->nb_tasks = nb_tasks;
+    pool->nb_done = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->submit_cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_wait(struct thread_pool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->nb_done < pool->nb_tasks)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pool->submitted = false;
+    pthread_cond_signal(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+thread_find_configure sets the number of threads and the cores that thread_find and two_pass_thread_find use (see
+thread_pool_create). By default, they use one thread for each core that the process is allowed to run on.
+The shared pool is created by the first search (or by thread_find_configure) under find_pool_mutex, so that the first
+searches of several threads create a single pool. thread_find_configure destroys the previous pool, so it must not be
+called while searches are running (the behavior is undefined otherwise).
+*/
+
+struct thread_pool *find_pool = NULL;
+pthread_mutex_t find_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void thread_find_configure(int nb_threads, const cpu_set_t *affinity) {
+    pthread_mutex_lock(&find_pool_mutex);
+    if (find_pool != NULL)
+        thread_pool_destroy(find_pool);
+    find_pool = thread_pool_create(nb_threads, affinity);
+    pthread_mutex_unlock(&find_pool_mutex);
+}
+
+struct thread_pool *get_find_pool() {
+    pthread_mutex_lock(&find_pool_mutex);
+    if (find_pool == NULL)
+        find_pool = thread_pool_create(0, NULL);
+    struct thread_pool *pool = find_pool;
+    pthread_mutex_unlock(&find_pool_mutex);
+    return pool;
+}
+
+/*
+Zone maps
+---------
+When U is sorted or clustered (e.g., timestamps, or values generated in runs), most of its blocks cannot contain the
+integers that a search looks for, but the kernels still read all of them. zone_map_build summarizes once each block of
+ZONE_MAP_BLOCK_SIZE integers of U with its minimum, its maximum and a bitset of the values that it contains (bit
+value & 63 for each value, so that the bitset is exact for the blocks whose values are within 64 consecutive values),
+and zone_map_pred_find, which takes the zone map and the arguments of thread_pred_find, returns the same indices but
+skips the blocks that cannot contain any integer satisfying the predicate: each thread searches its chunk (see
+split_range) with the kernel selected by ver, one run of consecutive candidate blocks at a time. The bitset is only
+tested for PRED_EQ and for PRED_RANGE when the range has at most 64 values.
+A zone map takes 16 bytes for each block, i.e., 1/1024 of the memory of U, which must not change after
+zone_map_build. On uniform data such as the default values, no block is skipped and the search costs as much as
+thread_pred_find.
+*/
+
+#define ZONE_MAP_BLOCK_SIZE 4096
+
+struct zone_map {
+    int nb_items;
+    int nb_blocks;
+    int *mins;
+    int *maxs;
+    uint64_t *bitsets;
+};
+
+struct zone_map_thread_data {
+    _Alignas(CACHE_LINE_SIZE) int *U;
+    int first_block;
+    int last_block;
+    struct zone_map *map;
+};
+
+void *zone_map_thread_function(void* thread_arg) {
+    struct zone_map_thread_data *my_data = (struct zone_map_thread_data*) thread_arg;
+    struct zone_map *map = my_data->map;
+    for (int b = my_data->first_block; b <= my_data->last_block; b++) {
+        int i_end = b == map->nb_blocks - 1 ? map->nb_items - 1 : (b + 1) * ZONE_MAP_BLOCK_SIZE - 1;
+        int min = INT_MAX, max = INT_MIN;
+        uint64_t bitset = 0;
+        for (int i = b * ZONE_MAP_BLOCK_SIZE; i <= i_end; i++) {
+            min = my_data->U[i] < min ? my_data->U[i] : min;
+            max = my_data->U[i] > max ? my_data->U[i] : max;
+            bitset |= (uint64_t) 1 << (my_data->U[i] & 63);
+        }
+        map->mins[b] = min;
+        map->maxs[b] = max;
+        map->bitsets[b] = bitset;
+    }
+    return NULL;
+}
+
+struct zone_map *zone_map_build(int *U, int nb_items) {
+    struct zone_map *map = (struct zone_map*) malloc(sizeof(struct zone_map));
+    map->nb_items = nb_items;
+    map->nb_blocks = (int) (((long) nb_items + ZONE_MAP_BLOCK_SIZE - 1) / ZONE_MAP_BLOCK_SIZE);
+    map->mins = (int*) malloc(map->nb_blocks * sizeof(int));
+    map->maxs = (int*) malloc(map->nb_blocks * sizeof(int));
+    map->bitsets = (uint64_t*) malloc(map->nb_blocks * sizeof(uint64_t));
+
+    // Each thread summarizes a range of consecutive blocks
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct zone_map_thread_data *zone_data_array = (struct zone_map_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct zone_map_thread_data));
+    for (int t = 0; t < nb_threads; t++) {
+        zone_data_array[t].U = U;
+        zone_data_array[t].first_block = (int) ((long) t * map->nb_blocks / nb_threads);
+        zone_data_array[t].last_block = (int) ((long) (t + 1) * map->nb_blocks / nb_threads) - 1;
+        zone_data_array[t].map = map;
+    }
+    thread_pool_submit(pool, zone_map_thread_function, zone_data_array, sizeof(struct zone_map_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+    free(zone_data_array);
+
+    return map;
+}
+
+void zone_map_free(struct zone_map *map) {
+    if (map == NULL)
+        return;
+    free(map->mins);
+    free(map->maxs);
+    free(map->bitsets);
+    free(map);
+}
+
+// Returns false if block b cannot contain any integer that satisfies pred.
+static inline bool zone_map_block_may_match(const struct zone_map *map, int b, const struct predicate *pred) {
+    int min = map->mins[b], max = map->maxs[b];
+    switch (pred->kind) {
+        case PRED_EQ:
+            return pred->val >= min && pred->val <= max && (map->bitsets[b] >> (pred->val & 63) & 1);
+        case PRED_NE: return min != pred->val || max != pred->val;
+        case PRED_LT: return min < pred->val;
+        case PRED_LE: return min <= pred->val;
+        case PRED_GT: return max > pred->val;
+        case PRED_GE: return max >= pred->val;
+        default: {
+            if (pred->val > max || pred->max < min)
+                return false;
+            long width = (long) pred->max - pred->val + 1;
+            if (width <= 0)
+                return false;
+            if (width >= 64)
+                return true;
+            uint64_t bits = ((uint64_t) 1 << width) - 1;
+            int shift = pred->val & 63;
+            bits = shift == 0 ? bits : bits << shift | bits >> (64 - shift);
+            return (map->bitsets[b] & bits) != 0;
+        }
+    }
+}
+
+// Runs find_kernel on the runs of consecutive blocks of map between i_start and i_end that may contain integers that
+// satisfy pred. find_kernel searches the group_size integers from each step (e.g., 8 for the 8-integer version), so
+// each run starts at the first step whose group overlaps its first block, which may be in the previous block.
+void zone_map_scan(const struct zone_map *map, int *U, int i_start, int i_end, int i_step, int group_size,
+                   const struct predicate *pred, find_kernel_function find_kernel, struct ind_buffer *buffer,
+                   struct find_limit *limit) {
+    if (i_start > i_end)
+        return;
+    int last_block = i_end / ZONE_MAP_BLOCK_SIZE;
+    for (int b = i_start / ZONE_MAP_BLOCK_SIZE; b <= last_block && !find_limit_stopped(limit); b++) {
+        if (!zone_map_block_may_match(map, b, pred))
+            continue;
+        int first_block = b;
+        while (b < last_block && zone_map_block_may_match(map, b + 1, pred))
+            b++;
+        long run_start = (long) first_block * ZONE_MAP_BLOCK_SIZE - group_size + 1;
+        long block_end = (long) (b + 1) * ZONE_MAP_BLOCK_SIZE - 1;
+        long run_end = block_end < i_end ? block_end : i_end;
+        long first = run_start <= i_start ? i_start : i_start + (run_start - i_start + i_step - 1) / i_step * i_step;
+        if (first <= run_end)
+            find_kernel(U, (int) first, (int) run_end, i_step, pred, buffer, limit);
+    }
+}
+
+/*
+Multithreaded implementation
+----------------------------
+*/
+
+// The inputs of a search and the kernels selected for it, which are shared by all its threads. There is no global
+// variable, so that several searches can run at the same time. If zone_map is not NULL, the threads skip the blocks of
+// U that it excludes (see zone_map_scan).
+struct find_query {
+    int *U;
+    int val;
+    struct predicate pred;
+    find_kernel_function find_kernel;
+    count_kernel_function count_kernel;
+    int group_size;
+    const struct zone_map *zone_map;
+};
+
+// Those variables are specific to each thread. Each thread_data is aligned on its own cache line(s), so that the threads
+// never write to the same cache line (there would be false sharing if the buffers were in a packed array).
+struct thread_data {
+    _Alignas(CACHE_LINE_SIZE) int i_start;
+    int i_end;
+    int i_step;
+    struct find_query *query;
+    struct ind_buffer buffer;
+    struct find_limit *limit;
+    int nb_find;
+#ifdef FIND_STATS
+    struct find_thread_stats stats;
+#endif
+};
+
+struct thread_data *alloc_thread_data(int nb_threads) {
+    struct thread_data *thread_data_array = (struct thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct thread_data));
+    for (int t = 0; t < nb_threads; t++) {
+        thread_data_array[t].query = NULL;
+        ind_buffer_init(&thread_data_array[t].buffer);
+    }
+    return thread_data_array;
+}
+
+void *find_thread_function(void* thread_arg) {
+
+    struct thread_data *my_data;
+    my_data = (struct thread_data*) thread_arg;
+
+    struct find_query *query = my_data->query;
+
+#ifdef FIND_STATS
+    struct find_thread_stats *stats = &my_data->stats;
+    int nb_grows = find_stats_nb_grows, nb_find = my_data->buffer.size;
+    long counters[FIND_STATS_NB_COUNTERS];
+    find_stats_read_counters(counters);
+    long t_start = get_time_ns();
+#endif
+
+    if (query->zone_map != NULL)
+        zone_map_scan(query->zone_map, query->U, my_data->i_start, my_data->i_end, my_data->i_step, query->group_size,
+                      &query->pred, query->find_kernel, &my_data->buffer, my_data->limit);
+    else
+        query->find_kernel(query->U, my_data->i_start, my_data->i_end, my_data->i_step, &query->pred,
+                           &my_data->buffer, my_data->limit);
+
+#ifdef FIND_STATS
+    long t_end = get_time_ns();
+    long stop_ns = atomic_load(&my_data->limit->stop_ns);
+    stats->scan_ns = t_end - t_start;
+    stats->nb_steps = my_data->i_end < my_data->i_start ? 0 : (my_data->i_end - my_data->i_start) / my_data->i_step + 1;
+    stats->nb_find = my_data->buffer.size - nb_find;
+    stats->nb_grows = find_stats_nb_grows - nb_grows;
+    stats->stop_latency_ns = stop_ns > 0 && t_end >= stop_ns ? t_end - stop_ns : -1;
+    long counters_end[FIND_STATS_NB_COUNTERS];
+    find_stats_read_counters(counters_end);
+    for (int c = 0; c < FIND_STATS_NB_COUNTERS; c++)
+        stats->counters[c] = counters[c] >= 0 && counters_end[c] >= 0 ? counters_end[c] - counters[c] : -1;
+#endif
+
+    return NULL;
+}
+
+void *count_thread_function(void* thread_arg) {
+
+    struct thread_data *my_data;
+    my_data = (struct thread_data*) thread_arg;
+
+    struct find_query *query = my_data->query;
+
+    my_data->nb_find = query->count_kernel(query->U, my_data->i_start, my_data->i_end, my_data->i_step, query->val);
+
+    return NULL;
+}
+
+// Selects the kernels to use depending on ver (scalar, 8-integer, 16-integer or strided vector computing) and on the
+// kind of predicate, and stores them in query. Returns false if ver cannot be used with i_step.
+bool select_kernels(struct find_query *query, int i_step, int ver, enum predicate_kind kind) {
+    switch (ver) {
+        case 0:
+            query->find_kernel = scalar_kernels[kind];
+            query->count_kernel = scalar_count_kernel;
+            query->group_size = 1;
+            return true;
+        case 1:
+            if (i_step % 8 != 0)
+                return false;
+            query->find_kernel = get_vect_kernel(kind);
+            query->count_kernel = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") ?
+                avx2_count_kernel : avx_count_kernel;
+            query->group_size = 8;
+            return true;
+        case 2:
+            if (i_step % 16 != 0)
+                return false;
+            if (!avx512_supported()) {
+                printf("AVX-512 is not supported by the processor.\n");
+                return false;
+            }
+            query->find_kernel = avx512_kernels[kind];
+            query->count_kernel = avx512_count_kernel;
+            query->group_size = 16;
+            return true;
+        case 3:
+            query->find_kernel = get_strided_kernel(kind);
+            query->count_kernel = count_only;
+            query->group_size = 1;
+            return true;
+        default:
+            printf("Invalid value for \"ver\".\n");
+            return false;
+    }
+}
+
+// Returns the first step from step (and before the next CACHE_LINE_SIZE bytes) whose index is at the start of a cache
+// line (if U is aligned on cache lines), or step if there is none.
+long cache_line_step(long step, long nb_steps, int i_start, int i_step) {
+    const int line_items = CACHE_LINE_SIZE / sizeof(int);
+    for (long s = step; s < nb_steps && (s - step) * i_step < line_items; s++)
+        if ((i_start + s * i_step) % line_items == 0)
+            return s;
+    return step;
+}
+
+// Splits the steps between i_start and i_end into nb_threads chunks of consecutive indices, one for each thread. The
+// chunks start at the start of a cache line when possible, so that the threads do not share the cache lines of U at
+// the limits of their chunks and the vector kernels only load partial groups at the limits of the range.
+void split_range(struct thread_data *thread_data_array, int nb_threads, int i_start, int i_end, int i_step) {
+    long nb_steps = (i_end - i_start) / i_step + 1;
+    for (int t = 0; t < nb_threads; t++) {
+        long first = t == 0 ? 0 : cache_line_step(t * nb_steps / nb_threads, nb_steps, i_start, i_step);
+        long next = cache_line_step((t + 1) * nb_steps / nb_threads, nb_steps, i_start, i_step);
+        thread_data_array[t].i_start = first * i_step + i_start;
+        thread_data_array[t].i_end = t == nb_threads - 1 ? i_end : next * i_step + i_start - 1;
+        thread_data_array[t].i_step = i_step;
+        thread_data_array[t].limit = NULL;
+        thread_data_array[t].nb_find = 0;
+    }
+}
+
+// Runs thread_function on pool for each element of thread_data_array and waits for it to finish running.
+void run_threads(struct thread_pool *pool, void *(*thread_function)(void*), struct thread_data *thread_data_array) {
+    thread_pool_submit(pool, thread_function, thread_data_array, sizeof(struct thread_data), pool->nb_threads);
+    thread_pool_wait(pool);
+}
+
+// Returns the number of indices in the buffers of the threads, or k if k >= 0 and there are more.
+int count_thread_buffers(struct thread_data *thread_data_array, int nb_threads, int k) {
+    int nb_find = 0;
+    for (int t = 0; t < nb_threads; t++)
+        nb_find += thread_data_array[t].buffer.size;
+    return k >= 0 && nb_find > k ? k : nb_find;
+}
+
+// Copies the first nb_find indices of the buffers of the threads, in the order of the chunks, to ind_val.
+void copy_thread_buffers(struct thread_data *thread_data_array, int nb_threads, int nb_find, int *ind_val) {
+    int nb_copied = 0;
+    for (int t = 0; t < nb_threads && nb_copied < nb_find; t++) {
+        struct ind_buffer *buffer = &thread_data_array[t].buffer;
+        int nb_copy = buffer->size < nb_find - nb_copied ? buffer->size : nb_find - nb_copied;
+        if (nb_copy > 0)
+            memcpy(ind_val + nb_copied, buffer->data, nb_copy * sizeof(int));
+        nb_copied += nb_copy;
+    }
+}
+
+// Concatenates the buffers of the threads in the order of the chunks into ind_val, up to k indices if k >= 0, frees
+// them and returns the number of indices.
+int gather_thread_buffers(struct thread_data *thread_data_array, int nb_threads, int k, int **ind_val) {
+    int nb_find = count_thread_buffers(thread_data_array, nb_threads, k);
+    *ind_val = (int*) malloc(nb_find * sizeof(int));
+    copy_thread_buffers(thread_data_array, nb_threads, nb_find, *ind_val);
+    for (int t = 0; t < nb_threads; t++)
+        ind_buffer_free(&thread_data_array[t].buffer);
+    return nb_find;
+}
+
+#ifdef FIND_STATS
+// Writes the statistics of the nb_threads threads of the last search, which took total_ns, to find_stats.
+void find_stats_collect(const struct thread_data *thread_data_array, int nb_threads, long total_ns) {
+    if (find_stats.nb_threads < nb_threads)
+        find_stats.threads = (struct find_thread_stats*) realloc(find_stats.threads,
+                                                                 nb_threads * sizeof(struct find_thread_stats));
+    find_stats.total_ns = total_ns;
+    find_stats.nb_threads = nb_threads;
+    find_stats.stop_latency_ns = -1;
+    long sum_ns = 0, max_ns = 0;
+    for (int t = 0; t < nb_threads; t++) {
+        find_stats.threads[t] = thread_data_array[t].stats;
+        sum_ns += find_stats.threads[t].scan_ns;
+        if (find_stats.threads[t].scan_ns > max_ns)
+            max_ns = find_stats.threads[t].scan_ns;
+        if (find_stats.threads[t].stop_latency_ns > find_stats.stop_latency_ns)
+            find_stats.stop_latency_ns = find_stats.threads[t].stop_latency_ns;
+    }
+    find_stats.imbalance = sum_ns > 0 ? (double) max_ns * nb_threads / sum_ns : 1;
+}
+#endif
+
+int zone_map_pred_find(const struct zone_map *map, int *U, int i_start, int i_end, int i_step, struct predicate pred,
+                       int **ind_val, int k, int ver) {
+
+#ifdef FIND_STATS
+    long t_start = get_time_ns();
+#endif
+
+    // Check the version to use (scalar, 8-integer, 16-integer or strided vector computing)
+    struct find_query query = {U, pred.val, pred, NULL, NULL, 0, map};
+    if (!select_kernels(&query, i_step, ver, pred.kind))
+        return -1;
+
+    // For small arrays, waking up the threads costs more than it saves
+    int nb_find;
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE && map != NULL) {
+        struct ind_buffer output;
+        ind_buffer_init(&output);
+        struct find_limit limit;
+        find_limit_init(&limit, k, 1);
+        zone_map_scan(map, U, i_start, i_end, i_step, query.group_size, &query.pred, query.find_kernel, &output,
+                      &limit);
+        if (k >= 0 && output.size > k)
+            output.size = k;
+        nb_find = ind_buffer_release(&output, ind_val);
+#ifdef FIND_STATS
+        find_stats_collect(NULL, 0, get_time_ns() - t_start);
+#endif
+        return nb_find;
+    }
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE) {
+        nb_find = ver == 0 ? pred_find(U, i_start, i_end, i_step, pred, ind_val) :
+                  ver == 1 ? vect_pred_find(U, i_start, i_end, i_step, pred, ind_val) :
+                  ver == 2 ? vect512_pred_find(U, i_start, i_end, i_step, pred, ind_val) :
+                             strided_pred_find(U, i_start, i_end, i_step, pred, ind_val);
+        struct ind_buffer output = {*ind_val, k >= 0 && nb_find > k ? k : nb_find, nb_find};
+        nb_find = ind_buffer_release(&output, ind_val);
+#ifdef FIND_STATS
+        find_stats_collect(NULL, 0, get_time_ns() - t_start);
+#endif
+        return nb_find;
+    }
+
+    // Initialize the variables
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct find_limit limit;
+    find_limit_init(&limit, k, nb_threads);
+
+    // Initialize the variables that are specific to the threads and run the threads
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    split_range(thread_data_array, nb_threads, i_start, i_end, i_step);
+    for (int t = 0; t < nb_threads; t++) {
+        thread_data_array[t].query = &query;
+        thread_data_array[t].limit = &limit;
+    }
+    run_threads(pool, find_thread_function, thread_data_array);
+
+    nb_find = gather_thread_buffers(thread_data_array, nb_threads, k, ind_val);
+#ifdef FIND_STATS
+    find_stats_collect(thread_data_array, nb_threads, get_time_ns() - t_start);
+#endif
+    free(thread_data_array);
+
+    return nb_find;
+}
+
+int thread_pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, int **ind_val, int k, int ver) {
+    return zone_map_pred_find(NULL, U, i_start, i_end, i_step, pred, ind_val, k, ver);
+}
+
+int thread_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val, int k, int ver) {
+    return thread_pred_find(U, i_start, i_end, i_step, predicate_eq(val), ind_val, k, ver);
+}
+
+int zone_map_find(const struct zone_map *map, int *U, int i_start, int i_end, int i_step, int val, int **ind_val, int k,
+                  int ver) {
+    return zone_map_pred_find(map, U, i_start, i_end, i_step, predicate_eq(val), ind_val, k, ver);
+}
+
+/*
+Search context
+--------------
+A find_ctx owns everything that a multithreaded search needs besides its inputs: its own thread pool (see
+thread_pool_create for nb_threads and affinity), the data of each thread with its buffer, the early termination state
+and the output buffer. find_ctx_pred_find (and find_ctx_find for val) returns the same indices as thread_pred_find,
+but *ind_val points to the output buffer of ctx, which must not be freed and is only valid until the next search with
+ctx. The buffers keep their capacity from one search to the next, so that there is no allocation at all once they are
+large enough.
+Since each context has its own workers, searches with different contexts can run at the same time from different
+threads (e.g., one context for each thread of a server). A context must only be used by one thread at a time.
+*/
+
+struct find_ctx {
+    struct thread_pool *pool;
+    struct thread_data *thread_data_array;
+    struct find_query query;
+    struct find_limit limit;
+    struct ind_buffer output;
+};
+
+struct find_ctx *find_ctx_create(int nb_threads, const cpu_set_t *affinity) {
+    struct find_ctx *ctx = (struct find_ctx*) aligned_alloc(CACHE_LINE_SIZE, sizeof(struct find_ctx));
+    ctx->pool = thread_pool_create(nb_threads, affinity);
+    ctx->thread_data_array = alloc_thread_data(ctx->pool->nb_threads);
+    ind_buffer_init(&ctx->output);
+    return ctx;
+}
+
+void find_ctx_destroy(struct find_ctx *ctx) {
+    for (int t = 0; t < ctx->pool->nb_threads; t++)
+        ind_buffer_free(&ctx->thread_data_array[t].buffer);
+    thread_pool_destroy(ctx->pool);
+    free(ctx->thread_data_array);
+    ind_buffer_free(&ctx->output);
+    free(ctx);
+}
+
+int find_ctx_pred_find(struct find_ctx *ctx, int *U, int i_start, int i_end, int i_step, struct predicate pred,
+                       const int **ind_val, int k, int ver) {
+
+#ifdef FIND_STATS
+    long t_start = get_time_ns();
+#endif
+
+    struct find_query *query = &ctx->query;
+    query->U = U;
+    query->val = pred.val;
+    query->pred = pred;
+    query->zone_map = NULL;
+    if (!select_kernels(query, i_step, ver, pred.kind))
+        return -1;
+
+    int nb_threads = ctx->pool->nb_threads;
+    find_limit_init(&ctx->limit, k, nb_threads);
+    ctx->output.size = 0;
+
+    // For small arrays, the calling thread searches the range by itself
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE) {
+        query->find_kernel(U, i_start, i_end, i_step, &query->pred, &ctx->output, &ctx->limit);
+        if (k >= 0 && ctx->output.size > k)
+            ctx->output.size = k;
+        *ind_val = ctx->output.data;
+#ifdef FIND_STATS
+        find_stats_collect(NULL, 0, get_time_ns() - t_start);
+#endif
+        return ctx->output.size;
+    }
+
+    struct thread_data *thread_data_array = ctx->thread_data_array;
+    split_range(thread_data_array, nb_threads, i_start, i_end, i_step);
+    for (int t = 0; t < nb_threads; t++) {
+        thread_data_array[t].query = query;
+        thread_data_array[t].limit = &ctx->limit;
+        thread_data_array[t].buffer.size = 0;
+    }
+    run_threads(ctx->pool, find_thread_function, thread_data_array);
+
+    int nb_find = count_thread_buffers(thread_data_array, nb_threads, k);
+    ind_buffer_reserve(&ctx->output, nb_find);
+    copy_thread_buffers(thread_data_array, nb_threads, nb_find, ctx->output.data);
+    ctx->output.size = nb_find;
+    *ind_val = ctx->output.data;
+#ifdef FIND_STATS
+    find_stats_collect(thread_data_array, nb_threads, get_time_ns() - t_start);
+#endif
+
+    return nb_find;
+}
+
+int find_ctx_find(struct find_ctx *ctx, int *U, int i_start, int i_end, int i_step, int val, const int **ind_val, int k,
+                  int ver) {
+    return find_ctx_pred_find(ctx, U, i_start, i_end, i_step, predicate_eq(val), ind_val, k, ver);
+}
+
+/*
+Two-pass multithreaded implementation
+-------------------------------------
+two_pass_thread_find returns the same indices as thread_find. The threads first count the occurrences in their chunk.
+Then, the offset of each chunk in ind_val is the sum of the counts of the previous chunks, and the threads write the
+indices directly into their slice of ind_val, which is allocated once with its exact size. There is no per-thread
+buffer to grow or to concatenate.
+If k >= 0, the chunks that start after the first k occurrences are not scanned again.
+*/
+
+int two_pass_thread_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val, int k, int ver) {
+
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE)
+        return thread_find(U, i_start, i_end, i_step, val, ind_val, k, ver);
+
+    struct find_query query = {U, val, predicate_eq(val), NULL, NULL, 0, NULL};
+    if (!select_kernels(&query, i_step, ver, PRED_EQ))
+        return -1;
+
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct find_limit limit;
+    find_limit_init(&limit, -1, nb_threads);
+
+    // First pass: count the occurrences in each chunk
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    split_range(thread_data_array, nb_threads, i_start, i_end, i_step);
+    for (int t = 0; t < nb_threads; t++)
+        thread_data_array[t].query = &query;
+    run_threads(pool, count_thread_function, thread_data_array);
+
+    int nb_find = 0;
+    for (int t = 0; t < nb_threads; t++)
+        nb_find += thread_data_array[t].nb_find;
+
+    // Second pass: write the indices into the slice of each chunk
+    *ind_val = (int*) malloc(nb_find * sizeof(int));
+    int offset = 0;
+    for (int t = 0; t < nb_threads; t++) {
+        thread_data_array[t].buffer.data = *ind_val + offset;
+        thread_data_array[t].buffer.size = 0;
+        thread_data_array[t].buffer.capacity = thread_data_array[t].nb_find;
+        thread_data_array[t].limit = &limit;
+        if (k >= 0 && offset >= k)
+            thread_data_array[t].i_end = thread_data_array[t].i_start - 1;
+        offset += thread_data_array[t].nb_find;
+    }
+    run_threads(pool, find_thread_function, thread_data_array);
+    free(thread_data_array);
+
+    // If necessary, ignore the extra indices
+    struct ind_buffer output = {*ind_val, k >= 0 && nb_find > k ? k : nb_find, nb_find};
+    return ind_buffer_release(&output, ind_val);
+}
+
+/*
+Ordered multithreaded implementation
+------------------------------------
+ordered_thread_find returns the first k occurrences of val (i.e., the ones with the lowest indices), or all of them if
+k < 0, whereas thread_find returns any k occurrences. The steps between i_start and i_end are split into blocks of
+about ORDERED_BLOCK_SIZE integers, and thread t scans blocks t, t + nb_threads, t + 2 * nb_threads... in this order, so
+that the threads progress together from the beginning of the range.
+Once a block has been scanned, it is marked as done in ordered_data. first_blocks is the number of consecutive blocks
+from the first one that are done, and nb_find_first_blocks the number of occurrences in those blocks. As soon as
+nb_find_first_blocks reaches k, the first k occurrences are known to be in the first first_blocks blocks, and the
+threads stop before scanning any of the following blocks.
+The occurrences of each block are written consecutively to the buffer of the thread that scanned it, and they are
+concatenated in the order of the blocks at the end.
+*/
+
+#define ORDERED_BLOCK_SIZE 65536
+
+struct ordered_block {
+    int thread;
+    int start;
+    int nb_find;
+    bool done;
+};
+
+struct ordered_data {
+    int i_start;
+    int i_end;
+    int i_step;
+    int block_steps;
+    int nb_blocks;
+    struct ordered_block *blocks;
+    struct find_query *query;
+    int k;
+    pthread_mutex_t mutex;
+    int first_blocks;
+    int nb_find_first_blocks;
+    atomic_int nb_blocks_needed;
+};
+
+struct ordered_thread_data {
+    _Alignas(CACHE_LINE_SIZE) struct ordered_data *ordered;
+    struct ind_buffer buffer;
+    int id;
+    int nb_threads;
+};
+
+void ordered_block_done(struct ordered_data *ordered, int b, int thread, int start, int nb_find) {
+
+    pthread_mutex_lock(&ordered->mutex);
+    ordered->blocks[b].thread = thread;
+    ordered->blocks[b].start = start;
+    ordered->blocks[b].nb_find = nb_find;
+    ordered->blocks[b].done = true;
+    // first_blocks stops moving once it covers the first k occurrences, so that nb_blocks_needed is only set once
+    while (atomic_load(&ordered->nb_blocks_needed) == ordered->nb_blocks &&
+           ordered->first_blocks < ordered->nb_blocks && ordered->blocks[ordered->first_blocks].done) {
+        ordered->nb_find_first_blocks += ordered->blocks[ordered->first_blocks].nb_find;
+        ordered->first_blocks++;
+        if (ordered->k >= 0 && ordered->nb_find_first_blocks >= ordered->k) {
+            atomic_store(&ordered->nb_blocks_needed, ordered->first_blocks);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ordered->mutex);
+}
+
+void *ordered_thread_function(void* thread_arg) {
+
+    struct ordered_thread_data *my_data = (struct ordered_thread_data*) thread_arg;
+    struct ordered_data *ordered = my_data->ordered;
+    struct ind_buffer *buffer = &my_data->buffer;
+    struct find_limit limit;
+    find_limit_init(&limit, -1, 1);
+
+    for (int b = my_data->id; b < ordered->nb_blocks; b += my_data->nb_threads) {
+        if (b >= atomic_load(&ordered->nb_blocks_needed))
+            break;
+        int block_start = ordered->i_start + b * ordered->block_steps * ordered->i_step;
+        int block_end = b == ordered->nb_blocks - 1 ? ordered->i_end :
+            block_start + ordered->block_steps * ordered->i_step - 1;
+        int start = buffer->size;
+        ordered->query->find_kernel(ordered->query->U, block_start, block_end, ordered->i_step, &ordered->query->pred,
+                                    buffer, &limit);
+        ordered_block_done(ordered, b, my_data->id, start, buffer->size - start);
+    }
+
+    return NULL;
+}
+
+int ordered_thread_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val, int k, int ver) {
+
+    struct find_query query = {U, val, predicate_eq(val), NULL, NULL, 0, NULL};
+    if (!select_kernels(&query, i_step, ver, PRED_EQ))
+        return -1;
+
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE)
+        return thread_find(U, i_start, i_end, i_step, val, ind_val, k, ver);
+
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+
+    // Split the range into blocks of whole steps
+    struct ordered_data ordered;
+    ordered.i_start = i_start;
+    ordered.i_end = i_end;
+    ordered.i_step = i_step;
+    ordered.block_steps = ORDERED_BLOCK_SIZE / i_step > 0 ? ORDERED_BLOCK_SIZE / i_step : 1;
+    ordered.nb_blocks = ((i_end - i_start) / i_step + ordered.block_steps) / ordered.block_steps;
+    ordered.blocks = (struct ordered_block*) calloc(ordered.nb_blocks, sizeof(struct ordered_block));
+    ordered.query = &query;
+    ordered.k = k;
+    pthread_mutex_init(&ordered.mutex, NULL);
+    ordered.first_blocks = 0;
+    ordered.nb_find_first_blocks = 0;
+    atomic_init(&ordered.nb_blocks_needed, ordered.nb_blocks);
+
+    struct ordered_thread_data *thread_data_array = (struct ordered_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct ordered_thread_data));
+    for (int t = 0; t < nb_threads; t++) {
+        thread_data_array[t].ordered = &ordered;
+        ind_buffer_init(&thread_data_array[t].buffer);
+        thread_data_array[t].id = t;
+        thread_data_array[t].nb_threads = nb_threads;
+    }
+    thread_pool_submit(pool, ordered_thread_function, thread_data_array, sizeof(struct ordered_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+
+    // Concatenate the occurrences of the first blocks, in order
+    int nb_find = k >= 0 && ordered.nb_find_first_blocks > k ? k : ordered.nb_find_first_blocks;
+    *ind_val = (int*) malloc(nb_find * sizeof(int));
+    int nb_copied = 0;
+    for (int b = 0; b < ordered.first_blocks && nb_copied < nb_find; b++) {
+        struct ordered_block *block = &ordered.blocks[b];
+        int nb_copy = block->nb_find < nb_find - nb_copied ? block->nb_find : nb_find - nb_copied;
+        if (nb_copy > 0)
+            memcpy(*ind_val + nb_copied, thread_data_array[block->thread].buffer.data + block->start,
+                   nb_copy * sizeof(int));
+        nb_copied += nb_copy;
+    }
+
+    for (int t = 0; t < nb_threads; t++)
+        ind_buffer_free(&thread_data_array[t].buffer);
+    free(thread_data_array);
+    free(ordered.blocks);
+    pthread_mutex_destroy(&ordered.mutex);
+
+    return nb_find;
+}
+
+/*
+Dynamic multithreaded implementation
+------------------------------------
+dynamic_thread_pred_find (and dynamic_thread_find for val) returns the same indices as thread_pred_find, in the same
+order, but does not give one chunk to each thread: the steps between i_start and i_end are split into tiles of about
+FIND_TILE_SIZE integers, and each thread takes the next tile that nobody has taken yet from next_tile (an atomic
+cursor) whenever it finishes one. A thread that is slower (e.g., an efficiency core, or a core shared with another
+process) or whose tiles contain many occurrences takes fewer tiles, so that the threads finish at about the same time,
+whereas the slowest chunk sets the execution time of thread_find. The counterpart is that a tile is not always
+searched by the thread that initialized it (see init_U).
+The occurrences of each tile are written consecutively to the buffer of the thread that searched it, and where they
+are is stored in tiles, so that they are concatenated in the order of the tiles at the end.
+*/
+
+#define FIND_TILE_SIZE 65536
+
+struct find_tile {
+    int thread;
+    int start;
+    int nb_find;
+};
+
+struct dynamic_data {
+    _Alignas(CACHE_LINE_SIZE) atomic_int next_tile;
+    _Alignas(CACHE_LINE_SIZE) int i_start;
+    int i_end;
+    int i_step;
+    int tile_steps;
+    int nb_tiles;
+    struct find_tile *tiles;
+    struct find_query *query;
+    struct find_limit *limit;
+};
+
+struct dynamic_thread_data {
+    _Alignas(CACHE_LINE_SIZE) struct dynamic_data *dynamic;
+    struct ind_buffer buffer;
+    int id;
+};
+
+void *dynamic_thread_function(void* thread_arg) {
+
+    struct dynamic_thread_data *my_data = (struct dynamic_thread_data*) thread_arg;
+    struct dynamic_data *dynamic = my_data->dynamic;
+    struct ind_buffer *buffer = &my_data->buffer;
+
+    for (int b = atomic_fetch_add_explicit(&dynamic->next_tile, 1, memory_order_relaxed); b < dynamic->nb_tiles;
+         b = atomic_fetch_add_explicit(&dynamic->next_tile, 1, memory_order_relaxed)) {
+        if (find_limit_stopped(dynamic->limit))
+            break;
+        int tile_start = dynamic->i_start + b * dynamic->tile_steps * dynamic->i_step;
+        int tile_end = b == dynamic->nb_tiles - 1 ? dynamic->i_end :
+            tile_start + dynamic->tile_steps * dynamic->i_step - 1;
+        int start = buffer->size;
+        dynamic->query->find_kernel(dynamic->query->U, tile_start, tile_end, dynamic->i_step, &dynamic->query->pred,
+                                    buffer, dynamic->limit);
+        dynamic->tiles[b].thread = my_data->id;
+        dynamic->tiles[b].start = start;
+        dynamic->tiles[b].nb_find = buffer->size - start;
+    }
+
+    return NULL;
+}
+
+int dynamic_thread_pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, int **ind_val, int k,
+                             int ver) {
+
+    struct find_query query = {U, pred.val, pred, NULL, NULL, 0, NULL};
+    if (!select_kernels(&query, i_step, ver, pred.kind))
+        return -1;
+
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE)
+        return thread_pred_find(U, i_start, i_end, i_step, pred, ind_val, k, ver);
+
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct find_limit limit;
+    find_limit_init(&limit, k, nb_threads);
+
+    // Split the range into tiles of whole steps (the tiles that are not searched because of k have no occurrence)
+    struct dynamic_data dynamic;
+    atomic_init(&dynamic.next_tile, 0);
+    dynamic.i_start = i_start;
+    dynamic.i_end = i_end;
+    dynamic.i_step = i_step;
+    dynamic.tile_steps = FIND_TILE_SIZE / i_step > 0 ? FIND_TILE_SIZE / i_step : 1;
+    dynamic.nb_tiles = ((i_end - i_start) / i_step + dynamic.tile_steps) / dynamic.tile_steps;
+    dynamic.tiles = (struct find_tile*) calloc(dynamic.nb_tiles, sizeof(struct find_tile));
+    dynamic.query = &query;
+    dynamic.limit = &limit;
+
+    struct dynamic_thread_data *thread_data_array = (struct dynamic_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct dynamic_thread_data));
+    for (int t = 0; t < nb_threads; t++) {
+        thread_data_array[t].dynamic = &dynamic;
+        ind_buffer_init(&thread_data_array[t].buffer);
+        thread_data_array[t].id = t;
+    }
+    thread_pool_submit(pool, dynamic_thread_function, thread_data_array, sizeof(struct dynamic_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+
+    // Concatenate the occurrences of the tiles, in order
+    int nb_find = 0;
+    for (int b = 0; b < dynamic.nb_tiles; b++)
+        nb_find += dynamic.tiles[b].nb_find;
+    if (k >= 0 && nb_find > k)
+        nb_find = k;
+    *ind_val = (int*) malloc(nb_find * sizeof(int));
+    int nb_copied = 0;
+    for (int b = 0; b < dynamic.nb_tiles && nb_copied < nb_find; b++) {
+        struct find_tile *tile = &dynamic.tiles[b];
+        int nb_copy = tile->nb_find < nb_find - nb_copied ? tile->nb_find : nb_find - nb_copied;
+        if (nb_copy > 0)
+            memcpy(*ind_val + nb_copied, thread_data_array[tile->thread].buffer.data + tile->start,
+                   nb_copy * sizeof(int));
+        nb_copied += nb_copy;
+    }
+
+    for (int t = 0; t < nb_threads; t++)
+        ind_buffer_free(&thread_data_array[t].buffer);
+    free(thread_data_array);
+    free(dynamic.tiles);
+
+    return nb_find;
+}
+
+int dynamic_thread_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val, int k, int ver) {
+    return dynamic_thread_pred_find(U, i_start, i_end, i_step, predicate_eq(val), ind_val, k, ver);
+}
+
+/*
+Multi-value search
+------------------
+find_many looks for the occurrences of each of the nb_vals values of vals within U between indices i_start and i_end,
+with step i_step, in a single pass over U: ind_vals[v] receives the nb_finds[v] indices of the occurrences of vals[v],
+as find would, and the total number of occurrences is returned (-1 if vals contains the same value twice).
+thread_find_many does the same with the threads of thread_find and the same chunks.
+The values are stored in value_set, an open addressing hash table, together with a bitmap of VALUE_FILTER_BITS bits in
+which the bit of the hash of each value is set. When i_step equals 1 and the processor supports AVX2, the kernel reads 8
+integers at a time and:
+- if there are at most FIND_MANY_BROADCAST_MAX values, compares them with each (broadcast) value,
+- otherwise, computes the hashes of the 8 integers and fetches their bits in the bitmap with _mm256_i32gather_epi32.
+  Only the integers whose bit is set (which is rare when few integers of U are in vals, since the bitmap fits in L1)
+  are looked for in the hash table.
+*/
+
+#define FIND_MANY_BROADCAST_MAX 8
+#define VALUE_FILTER_LOG2_BITS 16
+#define VALUE_FILTER_BITS (1 << VALUE_FILTER_LOG2_BITS)
+
+struct value_set {
+    const int *vals;
+    int nb_vals;
+    int *keys;
+    int *ids;
+    int log2_size;
+    unsigned int *filter;
+};
+
+static inline unsigned int value_hash(int val) {
+    return (unsigned int) val * 2654435761u;
+}
+
+// Returns the index of val in set->vals, or -1 if val is not in set.
+static inline int value_set_find(const struct value_set *set, int val) {
+    unsigned int mask = (1u << set->log2_size) - 1;
+    for (unsigned int slot = value_hash(val) >> (32 - set->log2_size); set->ids[slot] >= 0; slot = (slot + 1) & mask)
+        if (set->keys[slot] == val)
+            return set->ids[slot];
+    return -1;
+}
+
+bool value_set_init(struct value_set *set, const int *vals, int nb_vals) {
+
+    set->vals = vals;
+    set->nb_vals = nb_vals;
+    set->log2_size = 1;
+    while ((1 << set->log2_size) < 2 * nb_vals)
+        set->log2_size++;
+    set->keys = (int*) malloc((1 << set->log2_size) * sizeof(int));
+    set->ids = (int*) malloc((1 << set->log2_size) * sizeof(int));
+    memset(set->ids, -1, (1 << set->log2_size) * sizeof(int));
+    set->filter = (unsigned int*) calloc(VALUE_FILTER_BITS / 32, sizeof(unsigned int));
+
+    unsigned int mask = (1u << set->log2_size) - 1;
+    for (int v = 0; v < nb_vals; v++) {
+        if (value_set_find(set, vals[v]) >= 0) {
+            free(set->keys);
+            free(set->ids);
+            free(set->filter);
+            return false;
+        }
+        unsigned int slot = value_hash(vals[v]) >> (32 - set->log2_size);
+        while (set->ids[slot] >= 0)
+            slot = (slot + 1) & mask;
+        set->keys[slot] = vals[v];
+        set->ids[slot] = v;
+        unsigned int bit = value_hash(vals[v]) >> (32 - VALUE_FILTER_LOG2_BITS);
+        set->filter[bit >> 5] |= 1u << (bit & 31);
+    }
+
+    return true;
+}
+
+void value_set_free(struct value_set *set) {
+    free(set->keys);
+    free(set->ids);
+    free(set->filter);
+}
+
+void scalar_many_kernel(int *U, int i_start, int i_end, int i_step, const struct value_set *set,
+                        struct ind_buffer *buffers) {
+    int id;
+    for (int i = i_start; i <= i_end; i += i_step)
+        if ((id = value_set_find(set, U[i])) >= 0)
+            ind_buffer_push(&buffers[id], i);
+}
+
+// Looks for the values of set in U between i_start and i_end (with step 1).
+__attribute__((target("avx2")))
+void avx2_many_kernel(int *U, int i_start, int i_end, const struct value_set *set, struct ind_buffer *buffers) {
+
+    int i, j, v, id, mask;
+
+    if (set->nb_vals <= FIND_MANY_BROADCAST_MAX) {
+        __m256i vect_vals[FIND_MANY_BROADCAST_MAX];
+        int masks[FIND_MANY_BROADCAST_MAX];
+        for (v = 0; v < set->nb_vals; v++)
+            vect_vals[v] = _mm256_set1_epi32(set->vals[v]);
+
+        for (i = i_start; i + 8 < i_end; i += 8) {
+            __m256i vect_U = _mm256_loadu_si256((__m256i*) (U + i));
+            mask = 0;
+            for (v = 0; v < set->nb_vals; v++) {
+                masks[v] = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(vect_U, vect_vals[v])));
+                mask |= masks[v];
+            }
+            if (mask)
+                for (v = 0; v < set->nb_vals; v++)
+                    for (j = i; masks[v] != 0; j++) {
+                        if (masks[v] & 1)
+                            ind_buffer_push(&buffers[v], j);
+                        masks[v] >>= 1;
+                    }
+        }
+    } else {
+        __m256i vect_hash_mul = _mm256_set1_epi32((int) 2654435761u);
+        __m256i vect_bit_mask = _mm256_set1_epi32(31);
+        __m256i vect_one = _mm256_set1_epi32(1);
+
+        for (i = i_start; i + 8 < i_end; i += 8) {
+            __m256i vect_U = _mm256_loadu_si256((__m256i*) (U + i));
+            __m256i vect_bit = _mm256_srli_epi32(_mm256_mullo_epi32(vect_U, vect_hash_mul), 32 - VALUE_FILTER_LOG2_BITS);
+            __m256i vect_word = _mm256_i32gather_epi32((const int*) set->filter, _mm256_srli_epi32(vect_bit, 5), 4);
+            __m256i vect_test = _mm256_and_si256(_mm256_srlv_epi32(vect_word, _mm256_and_si256(vect_bit, vect_bit_mask)),
+                                                 vect_one);
+            mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(vect_test, vect_one)));
+            for (j = i; mask != 0; j++) {
+                if ((mask & 1) && (id = value_set_find(set, U[j])) >= 0)
+                    ind_buffer_push(&buffers[id], j);
+                mask >>= 1;
+            }
+        }
+    }
+
+    for (; i <= i_end; i++)
+        if ((id = value_set_find(set, U[i])) >= 0)
+            ind_buffer_push(&buffers[id], i);
+}
+
+void many_kernel(int *U, int i_start, int i_end, int i_step, const struct value_set *set, struct ind_buffer *buffers) {
+    if (i_step == 1 && __builtin_cpu_supports("avx2"))
+        avx2_many_kernel(U, i_start, i_end, set, buffers);
+    else
+        scalar_many_kernel(U, i_start, i_end, i_step, set, buffers);
+}
+
+int find_many(int *U, int i_start, int i_end, int i_step, const int *vals, int nb_vals, int **ind_vals,
+              int *nb_finds) {
+
+    struct value_set set;
+    if (!value_set_init(&set, vals, nb_vals))
+        return -1;
+
+    struct ind_buffer *buffers = (struct ind_buffer*) malloc(nb_vals * sizeof(struct ind_buffer));
+    for (int v = 0; v < nb_vals; v++)
+        ind_buffer_init(&buffers[v]);
+
+    many_kernel(U, i_start, i_end, i_step, &set, buffers);
+
+    int nb_find = 0;
+    for (int v = 0; v < nb_vals; v++) {
+        nb_finds[v] = ind_buffer_release(&buffers[v], &ind_vals[v]);
+        nb_find += nb_finds[v];
+    }
+
+    free(buffers);
+    value_set_free(&set);
+    return nb_find;
+}
+
+struct many_thread_data {
+    _Alignas(CACHE_LINE_SIZE) int *U;
+    int i_start;
+    int i_end;
+    int i_step;
+    const struct value_set *set;
+    struct ind_buffer *buffers;
+};
+
+void *many_thread_function(void* thread_arg) {
+    struct many_thread_data *my_data = (struct many_thread_data*) thread_arg;
+    many_kernel(my_data->U, my_data->i_start, my_data->i_end, my_data->i_step, my_data->set, my_data->buffers);
+    return NULL;
+}
+
+int thread_find_many(int *U, int i_start, int i_end, int i_step, const int *vals, int nb_vals, int **ind_vals,
+                     int *nb_finds) {
+
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE)
+        return find_many(U, i_start, i_end, i_step, vals, nb_vals, ind_vals, nb_finds);
+
+    struct value_set set;
+    if (!value_set_init(&set, vals, nb_vals))
+        return -1;
+
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+
+    // Split the range as in thread_find and give nb_vals buffers to each thread
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    struct many_thread_data *many_data_array = (struct many_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct many_thread_data));
+    split_range(thread_data_array, nb_threads, i_start, i_end, i_step);
+    for (int t = 0; t < nb_threads; t++) {
+        many_data_array[t].U = U;
+        many_data_array[t].i_start = thread_data_array[t].i_start;
+        many_data_array[t].i_end = thread_data_array[t].i_end;
+        many_data_array[t].i_step = i_step;
+        many_data_array[t].set = &set;
+        many_data_array[t].buffers = (struct ind_buffer*) malloc(nb_vals * sizeof(struct ind_buffer));
+        for (int v = 0; v < nb_vals; v++)
+            ind_buffer_init(&many_data_array[t].buffers[v]);
+    }
+
+    thread_pool_submit(pool, many_thread_function, many_data_array, sizeof(struct many_thread_data), nb_threads);
+    thread_pool_wait(pool);
+
+    // Concatenate the indices of each value in the order of the chunks
+    int nb_find = 0;
+    for (int v = 0; v < nb_vals; v++) {
+        nb_finds[v] = 0;
+        for (int t = 0; t < nb_threads; t++)
+            nb_finds[v] += many_data_array[t].buffers[v].size;
+        ind_vals[v] = (int*) malloc(nb_finds[v] * sizeof(int));
+        int nb_copied = 0;
+        for (int t = 0; t < nb_threads; t++) {
+            struct ind_buffer *buffer = &many_data_array[t].buffers[v];
+            if (buffer->size > 0)
+                memcpy(ind_vals[v] + nb_copied, buffer->data, buffer->size * sizeof(int));
+            nb_copied += buffer->size;
+            ind_buffer_free(buffer);
+        }
+        nb_find += nb_finds[v];
+    }
+
+    for (int t = 0; t < nb_threads; t++)
+        free(many_data_array[t].buffers);
+    free(many_data_array);
+    free(thread_data_array);
+    value_set_free(&set);
+    return nb_find;
+}
+
+/*
+Batched search
+--------------
+find_batch evaluates nb_requests independent requests at once: request q looks for the integers that satisfy
+requests[q].pred within U between indices requests[q].i_start and requests[q].i_end, with step requests[q].i_step.
+ind_vals[q] receives the nb_finds[q] indices that thread_pred_find would return for it (with k < 0 and the same ver),
+and the total number of indices is returned (-1 if ver cannot be used with the step of a request).
+Searching each request separately would read the integers of U that are in several windows once for each of them. The
+requests are sorted by i_start instead, and U is swept once from the first window to the last one, in blocks of
+FIND_BATCH_BLOCK_SIZE integers (which fit in L2): each block is searched for every request whose window overlaps it, so
+that it is only read from memory once, and the gaps between the windows are skipped. Within a block, each request
+searches the steps that start in the block, with the kernel selected for it, so that its indices are written in order.
+thread_find_batch splits the integers that are in at least one window (the union of the windows) into one chunk for
+each thread, and concatenates the indices of each request in the order of the chunks.
+*/
+
+#define FIND_BATCH_BLOCK_SIZE 16384
+
+struct find_request {
+    int i_start;
+    int i_end;
+    int i_step;
+    struct predicate pred;
+};
+
+struct batch_data {
+    int *U;
+    const struct find_request *requests;
+    int nb_requests;
+    int *order;
+    int i_start;
+    int i_end;
+    struct find_query *queries;
+    struct find_limit limit;
+};
+
+struct batch_thread_data {
+    _Alignas(CACHE_LINE_SIZE) struct batch_data *batch;
+    int i_start;
+    int i_end;
+    struct ind_buffer *buffers;
+};
+
+int compare_request_starts(const void *a, const void *b, void *requests) {
+    int start_a = ((const struct find_request*) requests)[*(const int*) a].i_start;
+    int start_b = ((const struct find_request*) requests)[*(const int*) b].i_start;
+    return (start_a > start_b) - (start_a < start_b);
+}
+
+// Selects the kernels of each request, sorts the non-empty requests by i_start in batch->order and sets the first and
+// last indices of their windows. Returns the number of non-empty requests, or -1 if ver cannot be used with the step of
+// a request.
+int batch_init(struct batch_data *batch, int *U, const struct find_request *requests, int nb_requests, int ver) {
+
+    batch->U = U;
+    batch->requests = requests;
+    batch->queries = (struct find_query*) malloc(nb_requests * sizeof(struct find_query));
+    batch->order = (int*) malloc(nb_requests * sizeof(int));
+    find_limit_init(&batch->limit, -1, 1);
+
+    batch->nb_requests = 0;
+    batch->i_start = INT_MAX;
+    batch->i_end = INT_MIN;
+    for (int q = 0; q < nb_requests; q++) {
+        struct find_query *query = &batch->queries[q];
+        query->U = U;
+        query->val = requests[q].pred.val;
+        query->pred = requests[q].pred;
+        query->zone_map = NULL;
+        if (!select_kernels(query, requests[q].i_step, ver, requests[q].pred.kind)) {
+            free(batch->queries);
+            free(batch->order);
+            return -1;
+        }
+        if (requests[q].i_start > requests[q].i_end)
+            continue;
+        batch->order[batch->nb_requests++] = q;
+        if (requests[q].i_start < batch->i_start)
+            batch->i_start = requests[q].i_start;
+        if (requests[q].i_end > batch->i_end)
+            batch->i_end = requests[q].i_end;
+    }
+    qsort_r(batch->order, batch->nb_requests, sizeof(int), compare_request_starts, (void*) requests);
+
+    return batch->nb_requests;
+}
+
+void batch_free(struct batch_data *batch) {
+    free(batch->queries);
+    free(batch->order);
+}
+
+// Searches the requests of batch between indices i_start and i_end of U, one block at a time. buffers[q] receives the
+// indices of request q.
+void batch_sweep(struct batch_data *batch, int i_start, int i_end, struct ind_buffer *buffers) {
+
+    const struct find_request *requests = batch->requests;
+    int *active = (int*) malloc(batch->nb_requests * sizeof(int));
+    int nb_active = 0, next = 0;
+
+    long block_start = i_start;
+    while (block_start <= i_end) {
+        long block_end = (block_start / FIND_BATCH_BLOCK_SIZE + 1) * FIND_BATCH_BLOCK_SIZE - 1;
+        if (block_end > i_end)
+            block_end = i_end;
+
+        // Add the requests whose window starts before the end of the block, and remove the ones that have ended
+        while (next < batch->nb_requests && requests[batch->order[next]].i_start <= block_end)
+            active[nb_active++] = batch->order[next++];
+        int nb_kept = 0;
+        for (int a = 0; a < nb_active; a++)
+            if (requests[active[a]].i_end >= block_start)
+                active[nb_kept++] = active[a];
+        nb_active = nb_kept;
+
+        // Skip the gap up to the next window
+        if (nb_active == 0) {
+            if (next == batch->nb_requests)
+                break;
+            block_start = requests[batch->order[next]].i_start;
+            continue;
+        }
+
+        for (int a = 0; a < nb_active; a++) {
+            const struct find_request *request = &requests[active[a]];
+            long nb_steps = (request->i_end - request->i_start) / request->i_step + 1;
+            long first = block_start <= request->i_start ? 0 :
+                (block_start - request->i_start + request->i_step - 1) / request->i_step;
+            long next_step = (block_end - request->i_start + request->i_step) / request->i_step;
+            if (next_step > nb_steps)
+                next_step = nb_steps;
+            if (first >= next_step)
+                continue;
+            struct find_query *query = &batch->queries[active[a]];
+            int end = next_step == nb_steps ? request->i_end : request->i_start + next_step * request->i_step - 1;
+            query->find_kernel(batch->U, request->i_start + first * request->i_step, end, request->i_step, &query->pred,
+                               &buffers[active[a]], &batch->limit);
+        }
+
+        block_start = block_end + 1;
+    }
+
+    free(active);
+}
+
+void *batch_thread_function(void* thread_arg) {
+    struct batch_thread_data *my_data = (struct batch_thread_data*) thread_arg;
+    batch_sweep(my_data->batch, my_data->i_start, my_data->i_end, my_data->buffers);
+    return NULL;
+}
+
+int find_batch(int *U, const struct find_request *requests, int nb_requests, int **ind_vals, int *nb_finds, int ver) {
+
+    struct batch_data batch;
+    if (batch_init(&batch, U, requests, nb_requests, ver) < 0)
+        return -1;
+
+    struct ind_buffer *buffers = (struct ind_buffer*) malloc(nb_requests * sizeof(struct ind_buffer));
+    for (int q = 0; q < nb_requests; q++)
+        ind_buffer_init(&buffers[q]);
+
+    if (batch.nb_requests > 0)
+        batch_sweep(&batch, batch.i_start, batch.i_end, buffers);
+
+    int nb_find = 0;
+    for (int q = 0; q < nb_requests; q++) {
+        nb_finds[q] = ind_buffer_release(&buffers[q], &ind_vals[q]);
+        nb_find += nb_finds[q];
+    }
+
+    free(buffers);
+    batch_free(&batch);
+    return nb_find;
+}
+
+// Returns the index of U that is at position pos of the union of the windows, whose (sorted and merged) intervals are
+// [starts[m], ends[m]].
+int batch_union_index(const int *starts, const int *ends, int nb_intervals, long pos) {
+    for (int m = 0; m < nb_intervals; m++) {
+        if (pos <= ends[m] - starts[m])
+            return starts[m] + pos;
+        pos -= ends[m] - starts[m] + 1;
+    }
+    return ends[nb_intervals - 1] + 1;
+}
+
+int thread_find_batch(int *U, const struct find_request *requests, int nb_requests, int **ind_vals, int *nb_finds,
+                      int ver) {
+
+    struct batch_data batch;
+    if (batch_init(&batch, U, requests, nb_requests, ver) < 0)
+        return -1;
+
+    // Merge the windows into disjoint intervals
+    int *starts = (int*) malloc(batch.nb_requests * sizeof(int));
+    int *ends = (int*) malloc(batch.nb_requests * sizeof(int));
+    int nb_intervals = 0;
+    long nb_items = 0;
+    for (int r = 0; r < batch.nb_requests; r++) {
+        const struct find_request *request = &requests[batch.order[r]];
+        if (nb_intervals > 0 && request->i_start <= (long) ends[nb_intervals - 1] + 1) {
+            if (request->i_end > ends[nb_intervals - 1])
+                ends[nb_intervals - 1] = request->i_end;
+        } else {
+            starts[nb_intervals] = request->i_start;
+            ends[nb_intervals++] = request->i_end;
+        }
+    }
+    for (int m = 0; m < nb_intervals; m++)
+        nb_items += ends[m] - starts[m] + 1;
+
+    if (nb_items < THREAD_FIND_MIN_SIZE) {
+        free(starts);
+        free(ends);
+        batch_free(&batch);
+        return find_batch(U, requests, nb_requests, ind_vals, nb_finds, ver);
+    }
+
+    // Give the same number of integers of the union to each thread, with chunks that start at the start of a cache line
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    const int line_items = CACHE_LINE_SIZE / sizeof(int);
+    struct batch_thread_data *batch_data_array = (struct batch_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct batch_thread_data));
+    for (int t = 0; t < nb_threads; t++) {
+        batch_data_array[t].batch = &batch;
+        batch_data_array[t].i_start = t == 0 ? starts[0] : batch_data_array[t - 1].i_end + 1;
+        batch_data_array[t].i_end = t == nb_threads - 1 ? ends[nb_intervals - 1] :
+            batch_union_index(starts, ends, nb_intervals, (t + 1) * nb_items / nb_threads) / line_items * line_items - 1;
+        if (batch_data_array[t].i_end < batch_data_array[t].i_start - 1)
+            batch_data_array[t].i_end = batch_data_array[t].i_start - 1;
+        batch_data_array[t].buffers = (struct ind_buffer*) malloc(nb_requests * sizeof(struct ind_buffer));
+        for (int q = 0; q < nb_requests; q++)
+            ind_buffer_init(&batch_data_array[t].buffers[q]);
+    }
+    free(starts);
+    free(ends);
+
+    thread_pool_submit(pool, batch_thread_function, batch_data_array, sizeof(struct batch_thread_data), nb_threads);
+    thread_pool_wait(pool);
+
+    // Concatenate the indices of each request in the order of the chunks
+    int nb_find = 0;
+    for (int q = 0; q < nb_requests; q++) {
+        nb_finds[q] = 0;
+        for (int t = 0; t < nb_threads; t++)
+            nb_finds[q] += batch_data_array[t].buffers[q].size;
+        ind_vals[q] = (int*) malloc(nb_finds[q] * sizeof(int));
+        int nb_copied = 0;
+        for (int t = 0; t < nb_threads; t++) {
+            struct ind_buffer *buffer = &batch_data_array[t].buffers[q];
+            if (buffer->size > 0)
+                memcpy(ind_vals[q] + nb_copied, buffer->data, buffer->size * sizeof(int));
+            nb_copied += buffer->size;
+            ind_buffer_free(buffer);
+        }
+        nb_find += nb_finds[q];
+    }
+
+    for (int t = 0; t < nb_threads; t++)
+        free(batch_data_array[t].buffers);
+    free(batch_data_array);
+    batch_free(&batch);
+    return nb_find;
+}
+
+/*
+Bitmap output
+-------------
+When many integers satisfy the predicate, writing their indices costs more memory bandwidth than reading U (4 bytes for
+each occurrence against 4 bytes for each integer). bitmap_pred_find and thread_bitmap_pred_find write one bit for each
+integer within U between indices i_start and i_end, with step i_step, instead: bit j of bitmap is set if
+U[i_start + j * i_step] satisfies pred. When i_step equals 1, the bits are written 64 at a time from the masks of the
+most efficient vector computing kernel (_mm256_movemask_ps, or the 16-bit masks of AVX-512).
+The bitmaps of the same range can be combined with bitmap_and and bitmap_or, so that several predicates can be
+evaluated without writing any index, and bitmap_count, bitmap_next and bitmap_to_indices count, iterate over and
+return the indices of the set bits.
+thread_bitmap_pred_find splits the bitmap into chunks of whole cache lines (BITMAP_CHUNK_BITS bits), so that the
+threads never write to the same cache line.
+*/
+
+#define BITMAP_CHUNK_BITS (CACHE_LINE_SIZE * 8)
+
+struct bitmap {
+    uint64_t *words;
+    int i_start;
+    int i_end;
+    int i_step;
+    int nb_bits;
+};
+
+// Initializes bitmap with all its bits cleared. Returns false if the range is empty.
+bool bitmap_init(struct bitmap *bitmap, int i_start, int i_end, int i_step) {
+    bitmap->words = NULL;
+    if (i_end < i_start || i_step <= 0)
+        return false;
+    bitmap->i_start = i_start;
+    bitmap->i_end = i_end;
+    bitmap->i_step = i_step;
+    bitmap->nb_bits = (i_end - i_start) / i_step + 1;
+    size_t size = ((size_t) bitmap->nb_bits + BITMAP_CHUNK_BITS - 1) / BITMAP_CHUNK_BITS * CACHE_LINE_SIZE;
+    bitmap->words = (uint64_t*) aligned_alloc(CACHE_LINE_SIZE, size);
+    memset(bitmap->words, 0, size);
+    return true;
+}
+
+void bitmap_free(struct bitmap *bitmap) {
+    free(bitmap->words);
+    bitmap->words = NULL;
+}
+
+static inline int bitmap_nb_words(const struct bitmap *bitmap) {
+    return (bitmap->nb_bits + 63) / 64;
+}
+
+static inline bool bitmap_same_range(const struct bitmap *a, const struct bitmap *b) {
+    return a->i_start == b->i_start && a->i_end == b->i_end && a->i_step == b->i_step;
+}
+
+// Sets dst to a & b. Returns false if the bitmaps do not cover the same range.
+bool bitmap_and(struct bitmap *dst, const struct bitmap *a, const struct bitmap *b) {
+    if (!bitmap_same_range(dst, a) || !bitmap_same_range(dst, b))
+        return false;
+    for (int w = 0; w < bitmap_nb_words(dst); w++)
+        dst->words[w] = a->words[w] & b->words[w];
+    return true;
+}
+
+// Sets dst to a | b. Returns false if the bitmaps do not cover the same range.
+bool bitmap_or(struct bitmap *dst, const struct bitmap *a, const struct bitmap *b) {
+    if (!bitmap_same_range(dst, a) || !bitmap_same_range(dst, b))
+        return false;
+    for (int w = 0; w < bitmap_nb_words(dst); w++)
+        dst->words[w] = a->words[w] | b->words[w];
+    return true;
+}
+
+int bitmap_count(const struct bitmap *bitmap) {
+    int nb_find = 0;
+    for (int w = 0; w < bitmap_nb_words(bitmap); w++)
+        nb_find += __builtin_popcountll(bitmap->words[w]);
+    return nb_find;
+}
+
+// Returns the index in U of the first set bit that is at index i or after it, or -1 if there is none, so that the
+// set bits can be iterated over with for (i = bitmap_next(bitmap, bitmap->i_start); i >= 0; i = bitmap_next(bitmap,
+// i + 1)).
+int bitmap_next(const struct bitmap *bitmap, int i) {
+    if (i > bitmap->i_end)
+        return -1;
+    int j = i <= bitmap->i_start ? 0 : (i - bitmap->i_start + bitmap->i_step - 1) / bitmap->i_step;
+    if (j >= bitmap->nb_bits)
+        return -1;
+    int w = j / 64;
+    uint64_t word = bitmap->words[w] & (~0ULL << (j % 64));
+    while (word == 0) {
+        if (++w >= bitmap_nb_words(bitmap))
+            return -1;
+        word = bitmap->words[w];
+    }
+    return bitmap->i_start + (w * 64 + __builtin_ctzll(word)) * bitmap->i_step;
+}
+
+// Writes the indices of the set bits in ind_val (as find would) and returns their number.
+int bitmap_to_indices(const struct bitmap *bitmap, int **ind_val) {
+    int nb_find = bitmap_count(bitmap);
+    *ind_val = (int*) malloc(nb_find * sizeof(int));
+    int n = 0;
+    for (int w = 0; w < bitmap_nb_words(bitmap); w++)
+        for (uint64_t word = bitmap->words[w]; word != 0; word &= word - 1)
+            (*ind_val)[n++] = bitmap->i_start + (w * 64 + __builtin_ctzll(word)) * bitmap->i_step;
+    return nb_find;
+}
+
+// A bitmap kernel writes the bits between bit_start (a multiple of 64) and bit_end of bitmap.
+typedef void (*bitmap_kernel_function)(int*, const struct predicate*, struct bitmap*, int, int);
+
+// Calls function(args..., kind) with kind as a constant, so that function is specialized for each kind of predicate.
+#define PREDICATE_DISPATCH(kind, function, ...)                                                                     \
+    switch (kind) {                                                                                                 \
+        case PRED_EQ: function(__VA_ARGS__, PRED_EQ); break;                                                        \
+        case PRED_NE: function(__VA_ARGS__, PRED_NE); break;                                                        \
+        case PRED_LT: function(__VA_ARGS__, PRED_LT); break;                                                        \
+        case PRED_LE: function(__VA_ARGS__, PRED_LE); break;                                                        \
+        case PRED_GT: function(__VA_ARGS__, PRED_GT); break;                                                        \
+        case PRED_GE: function(__VA_ARGS__, PRED_GE); break;                                                        \
+        default: function(__VA_ARGS__, PRED_RANGE); break;                                                          \
+    }
+
+// Writes the bits between bit and bit_end that are after the last whole word.
+static inline __attribute__((always_inline))
+void bitmap_tail(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit, int bit_end,
+                 enum predicate_kind kind) {
+    uint64_t word = 0;
+    int first = bit;
+    for (; bit <= bit_end; bit++)
+        word |= (uint64_t) predicate_test(kind, U[bitmap->i_start + bit * bitmap->i_step], pred->val, pred->max)
+                << (bit - first);
+    if (first <= bit_end)
+        bitmap->words[first / 64] = word;
+}
+
+static inline __attribute__((always_inline))
+void scalar_bitmap_pred_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start,
+                               int bit_end, enum predicate_kind kind) {
+    int j, i_step = bitmap->i_step;
+    for (j = bit_start; j + 63 <= bit_end; j += 64) {
+        int *V = U + bitmap->i_start + j * i_step;
+        uint64_t word = 0;
+        for (int b = 0; b < 64; b++)
+            word |= (uint64_t) predicate_test(kind, V[b * i_step], pred->val, pred->max) << b;
+        bitmap->words[j / 64] = word;
+    }
+    bitmap_tail(U, pred, bitmap, j, bit_end, kind);
+}
+
+void scalar_bitmap_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start, int bit_end) {
+    PREDICATE_DISPATCH(pred->kind, scalar_bitmap_pred_kernel, U, pred, bitmap, bit_start, bit_end)
+}
+
+// The vector computing kernels require i_step to be 1.
+static inline __attribute__((always_inline))
+void avx_bitmap_pred_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start, int bit_end,
+                            enum predicate_kind kind) {
+    __m128i vect_val = _mm_set1_epi32(pred->val);
+    __m128i vect_max = _mm_set1_epi32(pred->max);
+    int j;
+    for (j = bit_start; j + 63 <= bit_end; j += 64) {
+        int *V = U + bitmap->i_start + j;
+        uint64_t word = 0;
+        for (int g = 0; g < 8; g++)
+            word |= (uint64_t) avx_predicate_mask(V + 8 * g, vect_val, vect_max, kind) << (8 * g);
+        bitmap->words[j / 64] = word;
+    }
+    bitmap_tail(U, pred, bitmap, j, bit_end, kind);
+}
+
+void avx_bitmap_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start, int bit_end) {
+    PREDICATE_DISPATCH(pred->kind, avx_bitmap_pred_kernel, U, pred, bitmap, bit_start, bit_end)
+}
+
+__attribute__((target("avx2"))) static inline __attribute__((always_inline))
+void avx2_bitmap_pred_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start, int bit_end,
+                             enum predicate_kind kind) {
+    __m256i vect_val = _mm256_set1_epi32(pred->val);
+    __m256i vect_max = _mm256_set1_epi32(pred->max);
+    int j;
+    for (j = bit_start; j + 63 <= bit_end; j += 64) {
+        int *V = U + bitmap->i_start + j;
+        uint64_t word = 0;
+        for (int g = 0; g < 8; g++)
+            word |= (uint64_t) avx2_predicate_mask(_mm256_loadu_si256((__m256i*) (V + 8 * g)), vect_val, vect_max,
+                                                   kind) << (8 * g);
+        bitmap->words[j / 64] = word;
+    }
+    bitmap_tail(U, pred, bitmap, j, bit_end, kind);
+}
+
+__attribute__((target("avx2")))
+void avx2_bitmap_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start, int bit_end) {
+    PREDICATE_DISPATCH(pred->kind, avx2_bitmap_pred_kernel, U, pred, bitmap, bit_start, bit_end)
+}
+
+__attribute__((target("avx512f,popcnt"))) static inline __attribute__((always_inline))
+void avx512_bitmap_pred_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start,
+                               int bit_end, enum predicate_kind kind) {
+    __m512i vect_val = _mm512_set1_epi32(pred->val);
+    __m512i vect_max = _mm512_set1_epi32(pred->max);
+    int j;
+    for (j = bit_start; j + 63 <= bit_end; j += 64) {
+        int *V = U + bitmap->i_start + j;
+        uint64_t word = 0;
+        for (int g = 0; g < 4; g++)
+            word |= (uint64_t) avx512_predicate_mask(_mm512_loadu_si512(V + 16 * g), vect_val, vect_max, kind)
+                    << (16 * g);
+        bitmap->words[j / 64] = word;
+    }
+    bitmap_tail(U, pred, bitmap, j, bit_end, kind);
+}
+
+__attribute__((target("avx512f,popcnt")))
+void avx512_bitmap_kernel(int *U, const struct predicate *pred, struct bitmap *bitmap, int bit_start, int bit_end) {
+    PREDICATE_DISPATCH(pred->kind, avx512_bitmap_pred_kernel, U, pred, bitmap, bit_start, bit_end)
+}
+
+// Returns the most efficient bitmap kernel that the processor supports for i_step.
+bitmap_kernel_function get_bitmap_kernel(int i_step) {
+    if (i_step != 1)
+        return scalar_bitmap_kernel;
+    if (avx512_supported())
+        return avx512_bitmap_kernel;
+    if (__builtin_cpu_supports("avx2"))
+        return avx2_bitmap_kernel;
+    return avx_bitmap_kernel;
+}
+
+// Initializes bitmap for the range and writes its bits. Returns the number of set bits, or -1 if the range is empty.
+int bitmap_pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, struct bitmap *bitmap) {
+    if (!bitmap_init(bitmap, i_start, i_end, i_step))
+        return -1;
+    get_bitmap_kernel(i_step)(U, &pred, bitmap, 0, bitmap->nb_bits - 1);
+    return bitmap_count(bitmap);
+}
+
+struct bitmap_thread_data {
+    _Alignas(CACHE_LINE_SIZE) int *U;
+    const struct predicate *pred;
+    struct bitmap *bitmap;
+    bitmap_kernel_function kernel;
+    int bit_start;
+    int bit_end;
+};
+
+void *bitmap_thread_function(void* thread_arg) {
+    struct bitmap_thread_data *my_data = (struct bitmap_thread_data*) thread_arg;
+    if (my_data->bit_start <= my_data->bit_end)
+        my_data->kernel(my_data->U, my_data->pred, my_data->bitmap, my_data->bit_start, my_data->bit_end);
+    return NULL;
+}
+
+int thread_bitmap_pred_find(int *U, int i_start, int i_end, int i_step, struct predicate pred, struct bitmap *bitmap) {
+
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE)
+        return bitmap_pred_find(U, i_start, i_end, i_step, pred, bitmap);
+
+    if (!bitmap_init(bitmap, i_start, i_end, i_step))
+        return -1;
+
+    // Split the bitmap into nb_threads chunks of whole cache lines
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    long nb_chunks = ((long) bitmap->nb_bits + BITMAP_CHUNK_BITS - 1) / BITMAP_CHUNK_BITS;
+    struct bitmap_thread_data *bitmap_data_array = (struct bitmap_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct bitmap_thread_data));
+    for (int t = 0; t < nb_threads; t++) {
+        long bit_end = (t + 1) * nb_chunks / nb_threads * BITMAP_CHUNK_BITS - 1;
+        bitmap_data_array[t].U = U;
+        bitmap_data_array[t].pred = &pred;
+        bitmap_data_array[t].bitmap = bitmap;
+        bitmap_data_array[t].kernel = get_bitmap_kernel(i_step);
+        bitmap_data_array[t].bit_start = t * nb_chunks / nb_threads * BITMAP_CHUNK_BITS;
+        bitmap_data_array[t].bit_end = bit_end < bitmap->nb_bits ? bit_end : bitmap->nb_bits - 1;
+    }
+
+    thread_pool_submit(pool, bitmap_thread_function, bitmap_data_array, sizeof(struct bitmap_thread_data), nb_threads);
+    thread_pool_wait(pool);
+
+    free(bitmap_data_array);
+    return bitmap_count(bitmap);
+}
+
+/*
+Element types
+-------------
+Searching low-cardinality data (e.g., the default values between 0 and 100) stored as 32-bit integers reads 4 times
+more memory than needed, and the search is limited by the memory bandwidth. vect_find_T and thread_find_T (with T
+among i8, i16, u32 and i64, for int8_t, int16_t, uint32_t and int64_t) look for the occurrences of val in arrays of
+these types and write the indices of the occurrences in ind_val, as find would (with the same step semantics: when
+i_step equals 1 and the processor supports AVX2, they use vector computing, otherwise a scalar loop honors the step).
+thread_find_T splits the range between the threads as thread_find does and returns the first k occurrences that they
+find (all of them if k < 0).
+The AVX2 kernels compare 32 integers at a time for 8, 16 and 32 bits (_mm256_cmpeq_epi8, _mm256_cmpeq_epi16, whose
+results are packed into bytes, and 4 x _mm256_cmpeq_epi32) and 16 integers at a time for 64 bits (4 x
+_mm256_cmpeq_epi64), and loop over the bits of the mask with ctz. The kernels of each type are generated by
+TYPED_FIND_FUNCTIONS.
+*/
+
+// A typed kernel searches an array of its type for val (converted to the type).
+typedef void (*typed_find_kernel_function)(const void*, int, int, int, long, struct ind_buffer*, struct find_limit*);
+
+__attribute__((target("avx2"))) static inline
+unsigned int avx2_mask_i8(const int8_t *p, __m256i vect_val) {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*) p), vect_val));
+}
+
+__attribute__((target("avx2"))) static inline
+unsigned int avx2_mask_i16(const int16_t *p, __m256i vect_val) {
+    __m256i lo = _mm256_cmpeq_epi16(_mm256_loadu_si256((__m256i*) p), vect_val);
+    __m256i hi = _mm256_cmpeq_epi16(_mm256_loadu_si256((__m256i*) (p + 16)), vect_val);
+    // packs interleaves the 128-bit lanes of lo and hi, which permute puts back in order
+    return _mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8));
+}
+
+__attribute__((target("avx2"))) static inline
+unsigned int avx2_mask_u32(const uint32_t *p, __m256i vect_val) {
+    unsigned int mask = 0;
+    for (int g = 0; g < 4; g++)
+        mask |= (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i*) (p + 8 * g)), vect_val))) << (8 * g);
+    return mask;
+}
+
+__attribute__((target("avx2"))) static inline
+unsigned int avx2_mask_i64(const int64_t *p, __m256i vect_val) {
+    unsigned int mask = 0;
+    for (int g = 0; g < 4; g++)
+        mask |= (unsigned int) _mm256_movemask_pd(_mm256_castsi256_pd(
+            _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i*) (p + 4 * g)), vect_val))) << (4 * g);
+    return mask;
+}
+
+struct typed_thread_data {
+    _Alignas(CACHE_LINE_SIZE) const void *U;
+    long val;
+    typed_find_kernel_function kernel;
+    struct thread_data *chunk;
+};
+
+void *typed_find_thread_function(void* thread_arg) {
+    struct typed_thread_data *my_data = (struct typed_thread_data*) thread_arg;
+    struct thread_data *chunk = my_data->chunk;
+    my_data->kernel(my_data->U, chunk->i_start, chunk->i_end, chunk->i_step, my_data->val, &chunk->buffer,
+                    chunk->limit);
+    return NULL;
+}
+
+// Runs kernel on the threads of thread_find (or on the calling thread for small ranges).
+int typed_thread_find(const void *U, int i_start, int i_end, int i_step, long val, typed_find_kernel_function kernel,
+                      int **ind_val, int k) {
+
+    struct find_limit limit;
+    if (i_end - i_start + 1 < THREAD_FIND_MIN_SIZE) {
+        struct ind_buffer buffer;
+        ind_buffer_init(&buffer);
+        find_limit_init(&limit, k, 1);
+        kernel(U, i_start, i_end, i_step, val, &buffer, &limit);
+        if (k >= 0 && buffer.size > k)
+            buffer.size = k;
+        return ind_buffer_release(&buffer, ind_val);
+    }
+
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    find_limit_init(&limit, k, nb_threads);
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    struct typed_thread_data *typed_data_array = (struct typed_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct typed_thread_data));
+    split_range(thread_data_array, nb_threads, i_start, i_end, i_step);
+    for (int t = 0; t < nb_threads; t++) {
+        thread_data_array[t].limit = &limit;
+        typed_data_array[t].U = U;
+        typed_data_array[t].val = val;
+        typed_data_array[t].kernel = kernel;
+        typed_data_array[t].chunk = &thread_data_array[t];
+    }
+
+    thread_pool_submit(pool, typed_find_thread_function, typed_data_array, sizeof(struct typed_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+
+    int nb_find = gather_thread_buffers(thread_data_array, nb_threads, k, ind_val);
+    free(typed_data_array);
+    free(thread_data_array);
+    return nb_find;
+}
+
+#define TYPED_FIND_FUNCTIONS(T, type, lanes, set1)                                                                  \
+    void scalar_find_##T##_kernel(const void *V, int i_start, int i_end, int i_step, long val,                      \
+                                  struct ind_buffer *buffer, struct find_limit *limit) {                            \
+        const type *U = (const type*) V;                                                                            \
+        int nb_published = buffer->size;                                                                            \
+        for (int i = i_start; i <= i_end; i += i_step) {                                                            \
+            if (find_limit_stopped(limit))                                                                          \
+                break;                                                                                              \
+            if (U[i] == (type) val) {                                                                               \
+                ind_buffer_push(buffer, i);                                                                         \
+                find_limit_publish(limit, buffer->size, &nb_published);                                             \
+            }                                                                                                       \
+        }                                                                                                           \
+    }                                                                                                               \
+                                                                                                                    \
+    /* i_step must be 1 */                                                                                          \
+    __attribute__((target("avx2")))                                                                                 \
+    void avx2_find_##T##_kernel(const void *V, int i_start, int i_end, int i_step, long val,                        \
+                                struct ind_buffer *buffer, struct find_limit *limit) {                              \
+        (void) i_step;                                                                                              \
+        const type *U = (const type*) V;                                                                            \
+        __m256i vect_val = set1((type) val);                                                                        \
+        int *data = buffer->data;                                                                                   \
+        int nb_find = buffer->size;                                                                                 \
+        int i, nb_published = nb_find;                                                                              \
+        for (i = i_start; i + lanes - 1 <= i_end; i += lanes) {                                                     \
+            if (find_limit_stopped(limit))                                                                          \
+                break;                                                                                              \
+            unsigned int mask = avx2_mask_##T(U + i, vect_val);                                                     \
+            if (mask) {                                                                                             \
+                data = ind_buffer_reserve_at(buffer, nb_find, __builtin_popcount(mask));                            \
+                for (; mask != 0; mask &= mask - 1)                                                                 \
+                    data[nb_find++] = i + __builtin_ctz(mask);                                                      \
+                find_limit_publish(limit, nb_find, &nb_published);                                                  \
+            }                                                                                                       \
+        }                                                                                                           \
+        buffer->size = nb_find;                                                                                     \
+        if (i + lanes - 1 <= i_end)                                                                                 \
+            return;                                                                                                 \
+        scalar_find_##T##_kernel(V, i, i_end, 1, val, buffer, limit);                                               \
+    }                                                                                                               \
+                                                                                                                    \
+    typed_find_kernel_function get_find_##T##_kernel(int i_step) {                                                  \
+        return i_step == 1 && __builtin_cpu_supports("avx2") ? avx2_find_##T##_kernel : scalar_find_##T##_kernel;   \
+    }                                                                                                               \
+                                                                                                                    \
+    int vect_find_##T(const type *U, int i_start, int i_end, int i_step, type val, int **ind_val) {                 \
+        struct ind_buffer buffer;                                                                                   \
+        ind_buffer_init(&buffer);                                                                                   \
+        struct find_limit limit;                                                                                    \
+        find_limit_init(&limit, -1, 1);                                                                             \
+        get_find_##T##_kernel(i_step)(U, i_start, i_end, i_step, val, &buffer, &limit);                             \
+        return ind_buffer_release(&buffer, ind_val);                                                                \
+    }                                                                                                               \
+                                                                                                                    \
+    int thread_find_##T(const type *U, int i_start, int i_end, int i_step, type val, int **ind_val, int k) {        \
+        return typed_thread_find(U, i_start, i_end, i_step, val, get_find_##T##_kernel(i_step), ind_val, k);        \
+    }
+
+TYPED_FIND_FUNCTIONS(i8, int8_t, 32, _mm256_set1_epi8)
+TYPED_FIND_FUNCTIONS(i16, int16_t, 32, _mm256_set1_epi16)
+TYPED_FIND_FUNCTIONS(u32, uint32_t, 32, _mm256_set1_epi32)
+TYPED_FIND_FUNCTIONS(i64, int64_t, 16, _mm256_set1_epi64x)
+
+/*
+Value index
+-----------
+When U does not change and is searched many times, value_index_build builds once an index of the positions of each
+value of U, and indexed_find then returns the indices of the occurrences of val within U between indices i_start and
+i_end, with step i_step (as find would), in O(log(nb_items) + number of occurrences) instead of scanning U. If k >= 0,
+only the first k occurrences are returned. If index is NULL or was not built for U, indexed_find scans U with the
+threads (with ordered_thread_find if k >= 0, so that the result is the same).
+The positions are sorted by value, then by index, so that the occurrences of val are consecutive and sorted:
+- if the values of U are within a domain of at most VALUE_INDEX_MAX_DOMAIN values (e.g., [0, 100]), the positions are
+  sorted with a counting sort run by the threads of thread_find: each thread counts the values of its chunk, then
+  writes the indices of its chunk after those of the previous chunks, and offsets is indexed by val - min,
+- otherwise, the (value, index) pairs are sorted, keys contains the distinct values of U and the occurrences of val are
+  found with a binary search in keys.
+*/
+
+#define VALUE_INDEX_MAX_DOMAIN 65536
+
+struct value_index {
+    int *U;
+    int nb_items;
+    int min;
+    int max;
+    int nb_keys;
+    int *keys;          // NULL for the counting sort (direct) index
+    int *offsets;       // The positions of keys[j] (or of min + j) are between offsets[j] and offsets[j + 1]
+    int *positions;
+};
+
+struct index_thread_data {
+    _Alignas(CACHE_LINE_SIZE) int *U;
+    int i_start;
+    int i_end;
+    int min;
+    int max;
+    int *counts;
+    int *positions;
+};
+
+void *index_min_max_thread_function(void* thread_arg) {
+    struct index_thread_data *my_data = (struct index_thread_data*) thread_arg;
+    int min = INT_MAX, max = INT_MIN;
+    for (int i = my_data->i_start; i <= my_data->i_end; i++) {
+        min = my_data->U[i] < min ? my_data->U[i] : min;
+        max = my_data->U[i] > max ? my_data->U[i] : max;
+    }
+    my_data->min = min;
+    my_data->max = max;
+    return NULL;
+}
+
+void *index_count_thread_function(void* thread_arg) {
+    struct index_thread_data *my_data = (struct index_thread_data*) thread_arg;
+    for (int i = my_data->i_start; i <= my_data->i_end; i++)
+        my_data->counts[my_data->U[i] - my_data->min]++;
+    return NULL;
+}
+
+void *index_scatter_thread_function(void* thread_arg) {
+    struct index_thread_data *my_data = (struct index_thread_data*) thread_arg;
+    for (int i = my_data->i_start; i <= my_data->i_end; i++)
+        my_data->positions[my_data->counts[my_data->U[i] - my_data->min]++] = i;
+    return NULL;
+}
+
+// Orders the (value, index) pairs packed by value_index_build_sorted.
+int compare_packed_positions(const void *a, const void *b) {
+    unsigned long x = *(const unsigned long*) a, y = *(const unsigned long*) b;
+    return (x > y) - (x < y);
+}
+
+// Builds the index of a domain larger than VALUE_INDEX_MAX_DOMAIN by sorting the (value, index) pairs.
+void value_index_build_sorted(struct value_index *index) {
+
+    // The value is biased so that the unsigned order of the pairs is the order of the values
+    unsigned long *pairs = (unsigned long*) malloc(index->nb_items * sizeof(unsigned long));
+    for (int i = 0; i < index->nb_items; i++)
+        pairs[i] = (unsigned long) ((unsigned int) index->U[i] ^ 0x80000000u) << 32 | (unsigned int) i;
+    qsort(pairs, index->nb_items, sizeof(unsigned long), compare_packed_positions);
+
+    index->nb_keys = 0;
+    for (int i = 0; i < index->nb_items; i++)
+        index->nb_keys += i == 0 || pairs[i] >> 32 != pairs[i - 1] >> 32;
+    index->keys = (int*) malloc(index->nb_keys * sizeof(int));
+    index->offsets = (int*) malloc((index->nb_keys + 1) * sizeof(int));
+
+    int j = 0;
+    for (int i = 0; i < index->nb_items; i++) {
+        if (i == 0 || pairs[i] >> 32 != pairs[i - 1] >> 32) {
+            index->keys[j] = (int) ((unsigned int) (pairs[i] >> 32) ^ 0x80000000u);
+            index->offsets[j++] = i;
+        }
+        index->positions[i] = (int) (pairs[i] & 0xFFFFFFFFu);
+    }
+    index->offsets[j] = index->nb_items;
+    free(pairs);
+}
+
+// Builds the index of a domain of at most VALUE_INDEX_MAX_DOMAIN values with a counting sort run by the threads.
+void value_index_build_direct(struct value_index *index, struct thread_pool *pool,
+                              struct index_thread_data *index_data_array) {
+
+    int nb_threads = pool->nb_threads;
+    int domain = index->max - index->min + 1;
+    index->nb_keys = domain;
+    index->keys = NULL;
+    index->offsets = (int*) malloc((domain + 1) * sizeof(int));
+
+    for (int t = 0; t < nb_threads; t++) {
+        index_data_array[t].min = index->min;
+        index_data_array[t].counts = (int*) calloc(domain, sizeof(int));
+        index_data_array[t].positions = index->positions;
+    }
+    thread_pool_submit(pool, index_count_thread_function, index_data_array, sizeof(struct index_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+
+    // The positions of each value are those of chunk 0, then those of chunk 1, etc.
+    int offset = 0;
+    for (int j = 0; j < domain; j++) {
+        index->offsets[j] = offset;
+        for (int t = 0; t < nb_threads; t++) {
+            int count = index_data_array[t].counts[j];
+            index_data_array[t].counts[j] = offset;
+            offset += count;
+        }
+    }
+    index->offsets[domain] = offset;
+
+    thread_pool_submit(pool, index_scatter_thread_function, index_data_array, sizeof(struct index_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+
+    for (int t = 0; t < nb_threads; t++)
+        free(index_data_array[t].counts);
+}
+
+struct value_index *value_index_build(int *U, int nb_items) {
+
+    if (nb_items <= 0)
+        return NULL;
+
+    struct value_index *index = (struct value_index*) malloc(sizeof(struct value_index));
+    index->U = U;
+    index->nb_items = nb_items;
+    index->positions = (int*) malloc(nb_items * sizeof(int));
+
+    // Split U as in thread_find, so that each thread reads local memory (see init_U)
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    struct index_thread_data *index_data_array = (struct index_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct index_thread_data));
+    split_range(thread_data_array, nb_threads, 0, nb_items - 1, 1);
+    for (int t = 0; t < nb_threads; t++) {
+        index_data_array[t].U = U;
+        index_data_array[t].i_start = thread_data_array[t].i_start;
+        index_data_array[t].i_end = thread_data_array[t].i_end;
+    }
+
+    // Find the domain of the values
+    thread_pool_submit(pool, index_min_max_thread_function, index_data_array, sizeof(struct index_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+    index->min = index_data_array[0].min;
+    index->max = index_data_array[0].max;
+    for (int t = 1; t < nb_threads; t++) {
+        index->min = index_data_array[t].min < index->min ? index_data_array[t].min : index->min;
+        index->max = index_data_array[t].max > index->max ? index_data_array[t].max : index->max;
+    }
+
+    if ((long) index->max - index->min + 1 <= VALUE_INDEX_MAX_DOMAIN)
+        value_index_build_direct(index, pool, index_data_array);
+    else
+        value_index_build_sorted(index);
+
+    free(thread_data_array);
+    free(index_data_array);
+    return index;
+}
+
+void value_index_free(struct value_index *index) {
+    if (index == NULL)
+        return;
+    free(index->keys);
+    free(index->offsets);
+    free(index->positions);
+    free(index);
+}
+
+// Returns the first position in positions[first:last] that is greater than or equal to i.
+static int lower_position(const int *positions, int first, int last, int i) {
+    while (first < last) {
+        int middle = first + (last - first) / 2;
+        if (positions[middle] < i)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return first;
+}
+
+int indexed_find(const struct value_index *index, int *U, int i_start, int i_end, int i_step, int val, int **ind_val,
+                 int k) {
+
+    // Without an index, scan U with the strided kernels (which read the same indices as find for any step)
+    if (index == NULL || index->U != U || i_start < 0 || i_end >= index->nb_items)
+        return k >= 0 ? ordered_thread_find(U, i_start, i_end, i_step, val, ind_val, k, 3) :
+                        thread_find(U, i_start, i_end, i_step, val, ind_val, k, 3);
+
+    // Find the positions of val
+    int j = -1;
+    if (index->keys == NULL) {
+        if (val >= index->min && val <= index->max)
+            j = val - index->min;
+    } else {
+        int first = 0, last = index->nb_keys;
+        while (first < last) {
+            int middle = first + (last - first) / 2;
+            if (index->keys[middle] < val)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        if (first < index->nb_keys && index->keys[first] == val)
+            j = first;
+    }
+
+    int first = 0, last = 0;
+    if (j >= 0 && i_start <= i_end) {
+        first = lower_position(index->positions, index->offsets[j], index->offsets[j + 1], i_start);
+        last = lower_position(index->positions, first, index->offsets[j + 1], i_end + 1);
+    }
+
+    // With a step of 1, all the positions between i_start and i_end are occurrences
+    if (i_step == 1) {
+        int nb_find = k >= 0 && last - first > k ? k : last - first;
+        *ind_val = (int*) malloc(nb_find * sizeof(int));
+        memcpy(*ind_val, index->positions + first, nb_find * sizeof(int));
+        return nb_find;
+    }
+
+    struct ind_buffer buffer;
+    ind_buffer_init(&buffer);
+    for (int p = first; p < last && (k < 0 || buffer.size < k); p++)
+        if ((index->positions[p] - i_start) % i_step == 0)
+            ind_buffer_push(&buffer, index->positions[p]);
+    return ind_buffer_release(&buffer, ind_val);
+}
+
+/*
+Dictionary encoding
+-------------------
+dict_encode stores U as codes instead of 32-bit integers: the distinct values of U are sorted in values, and each
+integer is replaced by the index of its value in values, on 8 bits if U has at most 256 distinct values (e.g., the
+default values between 0 and 100) and on 16 bits otherwise, so that U takes 4 (or 2) times less memory and a search
+reads 4 (or 2) times less memory. dict_find translates val to its code once (with a binary search in values, and
+returns no index without reading the codes if val is not in U), and then runs thread_find_i8 (or thread_find_i16) on
+the codes, which compares 32 codes at a time with AVX2 without decoding them. It returns the same indices as
+thread_find on U.
+The codes are byte-aligned rather than packed on the minimum number of bits (7 bits for 101 values): the integers of a
+packed array straddle the lanes of the vectors, and unpacking them would cost more than the 12% of memory saved.
+The values of U must be within a domain of at most VALUE_INDEX_MAX_DOMAIN values (dict_encode returns NULL otherwise).
+The domain, the distinct values and the codes are computed by the threads of thread_find, on the chunks that they
+search (see init_U), as value_index_build does. values is sorted, so the order of the codes is the order of the values.
+*/
+
+struct dict_U {
+    int nb_items;
+    int nb_values;
+    int *values;
+    int code_bits;
+    void *codes;
+};
+
+struct dict_thread_data {
+    _Alignas(CACHE_LINE_SIZE) int *U;
+    int i_start;
+    int i_end;
+    int min;
+    const int *value_codes;
+    void *codes;
+    int code_bits;
+};
+
+void *dict_encode_thread_function(void* thread_arg) {
+    struct dict_thread_data *my_data = (struct dict_thread_data*) thread_arg;
+    if (my_data->code_bits == 8) {
+        int8_t *codes = (int8_t*) my_data->codes;
+        for (int i = my_data->i_start; i <= my_data->i_end; i++)
+            codes[i] = (int8_t) my_data->value_codes[my_data->U[i] - my_data->min];
+    } else {
+        int16_t *codes = (int16_t*) my_data->codes;
+        for (int i = my_data->i_start; i <= my_data->i_end; i++)
+            codes[i] = (int16_t) my_data->value_codes[my_data->U[i] - my_data->min];
+    }
+    return NULL;
+}
+
+struct dict_U *dict_encode(int *U, int nb_items) {
+
+    // Split U as in thread_find, so that each thread reads local memory (see init_U)
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    struct index_thread_data *index_data_array = (struct index_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct index_thread_data));
+    split_range(thread_data_array, nb_threads, 0, nb_items - 1, 1);
+    for (int t = 0; t < nb_threads; t++) {
+        index_data_array[t].U = U;
+        index_data_array[t].i_start = thread_data_array[t].i_start;
+        index_data_array[t].i_end = thread_data_array[t].i_end;
+    }
+
+    // Find the domain of the values
+    thread_pool_submit(pool, index_min_max_thread_function, index_data_array, sizeof(struct index_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+    int min = INT_MAX, max = INT_MIN;
+    for (int t = 0; t < nb_threads; t++) {
+        min = index_data_array[t].min < min ? index_data_array[t].min : min;
+        max = index_data_array[t].max > max ? index_data_array[t].max : max;
+    }
+    if (nb_items > 0 && (long) max - min + 1 > VALUE_INDEX_MAX_DOMAIN) {
+        free(thread_data_array);
+        free(index_data_array);
+        return NULL;
+    }
+    int domain = nb_items > 0 ? max - min + 1 : 0;
+
+    // Count the occurrences of each value of the domain in each chunk, and give a code to the values that occur
+    for (int t = 0; t < nb_threads; t++) {
+        index_data_array[t].min = min;
+        index_data_array[t].counts = (int*) calloc(domain + 1, sizeof(int));
+    }
+    thread_pool_submit(pool, index_count_thread_function, index_data_array, sizeof(struct index_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+
+    struct dict_U *dict = (struct dict_U*) malloc(sizeof(struct dict_U));
+    dict->nb_items = nb_items;
+    dict->nb_values = 0;
+    dict->values = (int*) malloc((domain + 1) * sizeof(int));
+    int *value_codes = (int*) malloc((domain + 1) * sizeof(int));
+    for (int v = 0; v < domain; v++) {
+        bool present = false;
+        for (int t = 0; t < nb_threads && !present; t++)
+            present = index_data_array[t].counts[v] > 0;
+        value_codes[v] = present ? dict->nb_values : -1;
+        if (present)
+            dict->values[dict->nb_values++] = min + v;
+    }
+    for (int t = 0; t < nb_threads; t++)
+        free(index_data_array[t].counts);
+    free(index_data_array);
+
+    // Encode the chunks
+    dict->code_bits = dict->nb_values <= 256 ? 8 : 16;
+    size_t size = ((size_t) nb_items * dict->code_bits / 8 + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    dict->codes = aligned_alloc(CACHE_LINE_SIZE, size > 0 ? size : CACHE_LINE_SIZE);
+    struct dict_thread_data *dict_data_array = (struct dict_thread_data*) aligned_alloc(CACHE_LINE_SIZE,
+        nb_threads * sizeof(struct dict_thread_data));
+    for (int t = 0; t < nb_threads; t++) {
+        dict_data_array[t].U = U;
+        dict_data_array[t].i_start = thread_data_array[t].i_start;
+        dict_data_array[t].i_end = thread_data_array[t].i_end;
+        dict_data_array[t].min = min;
+        dict_data_array[t].value_codes = value_codes;
+        dict_data_array[t].codes = dict->codes;
+        dict_data_array[t].code_bits = dict->code_bits;
+    }
+    thread_pool_submit(pool, dict_encode_thread_function, dict_data_array, sizeof(struct dict_thread_data),
+                       nb_threads);
+    thread_pool_wait(pool);
+
+    free(value_codes);
+    free(dict_data_array);
+    free(thread_data_array);
+    return dict;
+}
+
+void dict_free(struct dict_U *dict) {
+    if (dict == NULL)
+        return;
+    free(dict->values);
+    free(dict->codes);
+    free(dict);
+}
+
+int dict_find(const struct dict_U *dict, int i_start, int i_end, int i_step, int val, int **ind_val, int k) {
+
+    int first = 0, last = dict->nb_values;
+    while (first < last) {
+        int middle = first + (last - first) / 2;
+        if (dict->values[middle] < val)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    if (first == dict->nb_values || dict->values[first] != val) {
+        *ind_val = (int*) malloc(0);
+        return 0;
+    }
+
+    if (dict->code_bits == 8)
+        return thread_find_i8((const int8_t*) dict->codes, i_start, i_end, i_step, (int8_t) first, ind_val, k);
+    return thread_find_i16((const int16_t*) dict->codes, i_start, i_end, i_step, (int16_t) first, ind_val, k);
+}
+
+/*
+64-bit indices
+--------------
+The functions above take int indices and write int indices, which is compact (half the memory of 64-bit indices) but
+limits them to the first 2^31 integers of U. find64, vect_find64, pred_find64, thread_find64, thread_pred_find64 and
+count_only64 take the same arguments as find, vect_find, pred_find, thread_find, thread_pred_find and count_only with
+64-bit (long) indices, and write long indices in ind_val, so that they work for any size of U.
+They split the range into windows of at most FIND64_WINDOW_SIZE integers that start on a step, and run the 32-bit
+version on each window (U + the start of the window, with indices from 0), so that the kernels are the same, and the
+indices found in a window are offset by its start. If k >= 0, the windows after the first k occurrences are not
+searched.
+*/
+
+// Can be lowered at compile time (-DFIND64_WINDOW_SIZE=...), e.g., to test the windows on small arrays.
+#ifndef FIND64_WINDOW_SIZE
+#define FIND64_WINDOW_SIZE (1 << 30)
+#endif
+
+struct ind64_buffer {
+    long *data;
+    long size;
+    long capacity;
+};
+
+void ind64_buffer_init(struct ind64_buffer *buffer) {
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+// Appends the n indices of ind_val, offset by offset.
+void ind64_buffer_append(struct ind64_buffer *buffer, const int *ind_val, int n, long offset) {
+    if (buffer->size + n > buffer->capacity) {
+        long capacity = buffer->capacity < IND_BUFFER_MIN_CAPACITY ? IND_BUFFER_MIN_CAPACITY : buffer->capacity;
+        while (buffer->size + n > capacity)
+            capacity *= 2;
+        buffer->data = (long*) realloc(buffer->data, capacity * sizeof(long));
+        buffer->capacity = capacity;
+    }
+    for (int j = 0; j < n; j++)
+        buffer->data[buffer->size + j] = offset + ind_val[j];
+    buffer->size += n;
+}
+
+long ind64_buffer_release(struct ind64_buffer *buffer, long **ind_val) {
+    *ind_val = buffer->size > 0 ? (long*) realloc(buffer->data, buffer->size * sizeof(long)) : (long*) malloc(0);
+    if (buffer->size == 0)
+        free(buffer->data);
+    return buffer->size;
+}
+
+// Returns the number of integers of the window that starts at w_start, and writes the step to use within it in step.
+long find64_window(long w_start, long i_end, long i_step, int *step) {
+    long steps_per_window = i_step < FIND64_WINDOW_SIZE ? FIND64_WINDOW_SIZE / i_step : 1;
+    long w_size = steps_per_window * i_step < FIND64_WINDOW_SIZE ? steps_per_window * i_step : FIND64_WINDOW_SIZE;
+    *step = i_step < FIND64_WINDOW_SIZE ? (int) i_step : FIND64_WINDOW_SIZE;
+    return i_end - w_start + 1 < w_size ? i_end - w_start + 1 : w_size;
+}
+
+// Runs thread_pred_find (if threaded is true) or the 32-bit version selected by ver on each window.
+long windowed_pred_find64(int *U, long i_start, long i_end, long i_step, struct predicate pred, long **ind_val,
+                          long k, int ver, bool threaded) {
+
+    if (i_step <= 0)
+        return -1;
+
+    struct ind64_buffer buffer;
+    ind64_buffer_init(&buffer);
+    long steps_per_window = i_step < FIND64_WINDOW_SIZE ? FIND64_WINDOW_SIZE / i_step : 1;
+    for (long w_start = i_start; w_start <= i_end && (k < 0 || buffer.size < k); w_start += steps_per_window * i_step) {
+        int step, *window_ind_val;
+        int w_size = (int) find64_window(w_start, i_end, i_step, &step);
+        int window_k = k < 0 ? -1 : k - buffer.size < INT_MAX ? (int) (k - buffer.size) : INT_MAX;
+        int n = threaded ? thread_pred_find(U + w_start, 0, w_size - 1, step, pred, &window_ind_val, window_k, ver) :
+                ver == 0 ? pred_find(U + w_start, 0, w_size - 1, step, pred, &window_ind_val) :
+                ver == 1 ? vect_pred_find(U + w_start, 0, w_size - 1, step, pred, &window_ind_val) :
+                ver == 2 ? vect512_pred_find(U + w_start, 0, w_size - 1, step, pred, &window_ind_val) :
+                           strided_pred_find(U + w_start, 0, w_size - 1, step, pred, &window_ind_val);
+        if (n < 0) {
+            free(buffer.data);
+            return -1;
+        }
+        ind64_buffer_append(&buffer, window_ind_val, n, w_start);
+        free(window_ind_val);
+    }
+
+    return ind64_buffer_release(&buffer, ind_val);
+}
+
+long pred_find64(int *U, long i_start, long i_end, long i_step, struct predicate pred, long **ind_val) {
+    return windowed_pred_find64(U, i_start, i_end, i_step, pred, ind_val, -1, 0, false);
+}
+
+long find64(int *U, long i_start, long i_end, long i_step, int val, long **ind_val) {
+    return windowed_pred_find64(U, i_start, i_end, i_step, predicate_eq(val), ind_val, -1, 0, false);
+}
+
+long vect_find64(int *U, long i_start, long i_end, long i_step, int val, long **ind_val) {
+    return windowed_pred_find64(U, i_start, i_end, i_step, predicate_eq(val), ind_val, -1, 1, false);
+}
+
+long thread_pred_find64(int *U, long i_start, long i_end, long i_step, struct predicate pred, long **ind_val, long k,
+                        int ver) {
+    return windowed_pred_find64(U, i_start, i_end, i_step, pred, ind_val, k, ver, true);
+}
+
+long thread_find64(int *U, long i_start, long i_end, long i_step, int val, long **ind_val, long k, int ver) {
+    return windowed_pred_find64(U, i_start, i_end, i_step, predicate_eq(val), ind_val, k, ver, true);
+}
+
+long count_only64(int *U, long i_start, long i_end, long i_step, int val) {
+
+    if (i_step <= 0)
+        return -1;
+
+    long nb_find = 0;
+    long steps_per_window = i_step < FIND64_WINDOW_SIZE ? FIND64_WINDOW_SIZE / i_step : 1;
+    for (long w_start = i_start; w_start <= i_end; w_start += steps_per_window * i_step) {
+        int step;
+        int w_size = (int) find64_window(w_start, i_end, i_step, &step);
+        nb_find += count_only(U + w_start, 0, w_size - 1, step, val);
+    }
+    return nb_find;
 }
 
 /*
-Scalar implementation
----------------------
-This is the basic implementation, which looks for all occurrences of val within U between indices i_start and i_stop,
-with step i_step, and writes the indices of the occurrences of val in ind_val.
+Streaming search
+----------------
+stream_find looks for the occurrences of val in a file of native 32-bit integers that may be larger than the memory
+(and than the 2^31 integers of an int index), and writes their indices in the file (as 64-bit integers) in ind_val.
+The file is read in chunks of STREAM_CHUNK_SIZE integers with pread, with double buffering: while thread_find searches
+one chunk with the threads of thread_find, a loader thread reads the next chunk into the other buffer, so that the
+search is hidden behind the reads as long as it is faster than the disk. The indices found in a chunk are offset by
+the index of its first integer in the file. As with thread_find, ver selects the kernels (the whole file is searched,
+in groups of 8 integers for ver 1 and 16 for ver 2) and, if k >= 0, the chunks after the first k occurrences are not
+read. Returns the number of occurrences, or -1 if the file cannot be read, if its size is not a multiple of the size
+of an integer (e.g., a truncated file) or if ver is not supported.
 */
 
-int find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val) {
+#define STREAM_CHUNK_SIZE (1 << 24)
+#define STREAM_BUFFER_ALIGNMENT 4096
 
-    *ind_val = (int*) malloc(0);
-    int nb_find = 0;
+struct stream_load {
+    pthread_t thread;
+    int fd;
+    int *buffer;
+    long offset;
+    int nb_items;
+    bool ok;
+};
 
-    for (int i = i_start; i <= i_end; i += i_step)
-        if (U[i] == val) {
-            nb_find++;
-            *ind_val = (int*) realloc(*ind_val, nb_find * sizeof(int));
-            (*ind_val)[nb_find - 1] = i;
-        }
+// Reads nb_items integers from the offset-th integer of the file into buffer.
+void *stream_load_function(void* thread_arg) {
+    struct stream_load *load = (struct stream_load*) thread_arg;
+    size_t size = (size_t) load->nb_items * sizeof(int), nb_read = 0;
+    while (nb_read < size) {
+        ssize_t n = pread(load->fd, (char*) load->buffer + nb_read, size - nb_read,
+                          (off_t) load->offset * sizeof(int) + nb_read);
+        if (n <= 0 && !(n < 0 && errno == EINTR))
+            break;
+        nb_read += n > 0 ? n : 0;
+    }
+    load->ok = nb_read == size;
+    return NULL;
+}
 
-    return nb_find;
+// Starts reading the c-th chunk of the file into buffer.
+void stream_load_start(struct stream_load *load, int fd, int *buffer, long c, long nb_items) {
+    load->fd = fd;
+    load->buffer = buffer;
+    load->offset = c * STREAM_CHUNK_SIZE;
+    load->nb_items = nb_items - load->offset < STREAM_CHUNK_SIZE ? nb_items - load->offset : STREAM_CHUNK_SIZE;
+    pthread_create(&load->thread, NULL, stream_load_function, load);
 }
 
-/*
-Vector computing implementation
--------------------------------
-This is the version that makes the most of vector computing.
-i_step must be a multiple of 8.
-*/
+long stream_find(const char *path, int val, long **ind_val, long k, int ver) {
 
-int vect_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val) {
+    // The kernels search the whole chunk with their own group size
+    struct find_query query;
+    if (!select_kernels(&query, 16, ver, PRED_EQ))
+        return -1;
+    int i_step = query.group_size;
 
-    if (i_step % 8 != 0)
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        printf("Cannot open \"%s\".\n", path);
+        if (fd >= 0)
+            close(fd);
         return -1;
+    }
+    if (file_stat.st_size % sizeof(int) != 0) {
+        printf("Cannot read \"%s\".\n", path);
+        close(fd);
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-    *ind_val = (int*) malloc(0);
-    int nb_find = 0;
-    __m256 vect_val = _mm256_castsi256_ps(_mm256_set1_epi32(val));
+    long nb_items = file_stat.st_size / sizeof(int);
+    long nb_chunks = k != 0 ? (nb_items + STREAM_CHUNK_SIZE - 1) / STREAM_CHUNK_SIZE : 0;
+    int *buffers[2];
+    for (int b = 0; b < 2; b++)
+        buffers[b] = (int*) aligned_alloc(STREAM_BUFFER_ALIGNMENT, STREAM_CHUNK_SIZE * sizeof(int));
 
-    int i, j, mask;
-    for (i = i_start; i + 8 < i_end; i += i_step) {
-        mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps((float*) (U + i)), vect_val, _CMP_EQ_OS));
-        if (mask) {
-            *ind_val = (int*) realloc(*ind_val, (nb_find + count_ones_table[mask]) * sizeof(int));
-            for (j = i; mask != 0; j++) {
-                if (mask & 1) {
-                    (*ind_val)[nb_find] = j;
-                    nb_find++;
-                }
-                mask >>= 1;
-            }
+    struct ind64_buffer buffer;
+    ind64_buffer_init(&buffer);
+    bool ok = true;
+    struct stream_load loads[2];
+    if (nb_chunks > 0)
+        stream_load_start(&loads[0], fd, buffers[0], 0, nb_items);
+
+    for (long c = 0; c < nb_chunks; c++) {
+
+        // Wait for the chunk, and start reading the next one into the other buffer
+        struct stream_load *load = &loads[c % 2];
+        pthread_join(load->thread, NULL);
+        if (!load->ok) {
+            printf("Cannot read \"%s\".\n", path);
+            ok = false;
+            break;
         }
-    }
+        if (c + 1 < nb_chunks)
+            stream_load_start(&loads[(c + 1) % 2], fd, buffers[(c + 1) % 2], c + 1, nb_items);
 
-    for (; i <= i_end; i++)
-        if (U[i] == val) {
-            nb_find++;
-            *ind_val = (int*) realloc(*ind_val, nb_find * sizeof(int));
-            (*ind_val)[nb_find - 1] = i;
+        // Search the chunk and append the indices of its occurrences (at most STREAM_CHUNK_SIZE, so k fits in an int)
+        int *chunk_ind_val;
+        int chunk_k = k >= 0 && k - buffer.size < STREAM_CHUNK_SIZE ? (int) (k - buffer.size) : -1;
+        int nb_chunk_find = thread_find(load->buffer, 0, load->nb_items - 1, i_step, val, &chunk_ind_val, chunk_k,
+                                        ver);
+        ind64_buffer_append(&buffer, chunk_ind_val, nb_chunk_find, load->offset);
+        free(chunk_ind_val);
+
+        // Once k occurrences are found, wait for the chunk that is being read and stop
+        if (k >= 0 && buffer.size >= k) {
+            if (c + 1 < nb_chunks)
+                pthread_join(loads[(c + 1) % 2].thread, NULL);
+            break;
         }
+    }
 
-    return nb_find;
+    free(buffers[0]);
+    free(buffers[1]);
+    close(fd);
+
+    // The next chunk is only read once the current one is read, so no read is pending after a failure
+    if (!ok) {
+        free(buffer.data);
+        *ind_val = NULL;
+        return -1;
+    }
+    return ind64_buffer_release(&buffer, ind_val);
 }
 
 /*
-Multithreaded implementation
-----------------------------
+alloc_U() and generate_U()
+--------------------------
+alloc_U allocates an array of nb_items integers, aligned on cache lines, and generate_U fills it with random integers.
+On NUMA machines, a page is placed on the node of the core that writes it first. Therefore, the array is initialized by
+the threads of thread_find, and each thread writes the chunk that it reads afterwards in thread_find (the same chunks
+are given to the same threads, see thread_pool and split_range), so that the threads only read local memory when
+searching the whole array.
+alloc_U64 and generate_U64 do the same for any number of integers: U is initialized in windows of FIND64_WINDOW_SIZE
+integers, each of which is split as thread_find64 splits it (i.e., as thread_find splits a window).
+The random integers do not depend on the number of threads: U[i] only depends on seed and i, which are mixed by
+random_at (SplitMix64, a few multiplications and shifts without any state carried from one integer to the next, so
+that any chunk can be generated on its own), and the random bits are mapped to [min_val, max_val] with a multiplication
+instead of a modulo. generate_U_seeded returns the same array for the same seed, and generate_U uses a seed from
+rand().
+generate_U_matches controls the density of matches instead: each integer equals val with probability density, and is
+a random integer of [min_val, max_val] other than val otherwise. If cluster_size > 1, it is decided for each group of
+cluster_size consecutive integers instead, so that the matches come in runs of cluster_size integers (e.g., sorted or
+time-ordered data) with the same overall density.
 */
 
-// To avoid global variables, we could incorporate them to thread_data and feed them to watch_nb_find_thread.
-bool stop_threads = false;
-int nb_find_thread[NB_THREADS];
-int *U_threads;
-int val_threads;
-
-// Those variables are specific to each thread.
-struct thread_data {
-    int i_start;
-    int i_end;
-    int i_step;
-    int **ind_val;
-    int *nb_find;
+struct init_data {
+    _Alignas(CACHE_LINE_SIZE) int *U;
+    long i_start;
+    long i_end;
+    int min_val;
+    int max_val;
+    uint64_t seed;
+    int val;
+    uint64_t match_threshold;
+    int cluster_size;
 };
 
-void *scalar_thread_function(void* thread_arg) {
+// Returns the i-th random number of the sequence of seed.
+static inline uint64_t random_at(uint64_t seed, uint64_t i) {
+    uint64_t z = seed + (i + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
 
-    struct thread_data *my_data;
-    my_data = (struct thread_data*) thread_arg;
-    int i_start = my_data->i_start;
-    int i_end = my_data->i_end;
-    int i_step = my_data->i_step;
-    int **ind_val = my_data->ind_val;
-    int *nb_find = my_data->nb_find;
+// Maps 32 random bits to [min_val, max_val].
+static inline int random_in_range(uint32_t r, int min_val, int max_val) {
+    return (int) (min_val + (long) (((uint64_t) r * (uint64_t) ((long) max_val - min_val + 1)) >> 32));
+}
 
-    *ind_val = (int*) malloc(0);
+void *zero_thread_function(void* thread_arg) {
+    struct init_data *my_data = (struct init_data*) thread_arg;
+    memset(my_data->U + my_data->i_start, 0, (size_t) (my_data->i_end - my_data->i_start + 1) * sizeof(int));
+    return NULL;
+}
 
-    for (int i = i_start; i <= i_end; i += i_step) {
-        if (stop_threads)
-            pthread_exit(NULL);
-        if (U_threads[i] == val_threads) {
-            (*nb_find)++;
-            *ind_val = (int*) realloc(*ind_val, *nb_find * sizeof(int));
-            (*ind_val)[*nb_find - 1] = i;
-        }
-    }
+void *generate_thread_function(void* thread_arg) {
+    struct init_data *my_data = (struct init_data*) thread_arg;
+    int *U = my_data->U;
+    uint64_t seed = my_data->seed;
+    int min_val = my_data->min_val, max_val = my_data->max_val;
+    for (long i = my_data->i_start; i <= my_data->i_end; i++)
+        U[i] = random_in_range((uint32_t) random_at(seed, i), min_val, max_val);
+    return NULL;
+}
 
-    pthread_exit(NULL);
+void *generate_matches_thread_function(void* thread_arg) {
+    struct init_data *my_data = (struct init_data*) thread_arg;
+    int *U = my_data->U;
+    uint64_t seed = my_data->seed;
+    int min_val = my_data->min_val, max_val = my_data->max_val, val = my_data->val;
+    for (long i = my_data->i_start; i <= my_data->i_end; i++) {
+        uint64_t r = random_at(seed, i);
+        uint64_t match_r = my_data->cluster_size > 1 ? random_at(~seed, i / my_data->cluster_size) : r;
+        int x = random_in_range((uint32_t) r, min_val, max_val);
+        U[i] = (match_r >> 32) < my_data->match_threshold ? val : x != val ? x : x < max_val ? x + 1 : min_val;
+    }
+    return NULL;
 }
 
-void *vect_thread_function(void* thread_arg) {
+// Runs init_function on the chunks of U that the threads of thread_find search in each window of w_size integers (all of
+// U for thread_find, FIND64_WINDOW_SIZE for thread_find64), with the parameters of init (if not NULL).
+int* init_U(void *(*init_function)(void*), long nb_items, long w_size, const struct init_data *init) {
 
-    struct thread_data *my_data;
-    my_data = (struct thread_data*) thread_arg;
-    int i_start = my_data->i_start;
-    int i_end = my_data->i_end;
-    int i_step = my_data->i_step;
-    int **ind_val = my_data->ind_val;
-    int *nb_find = my_data->nb_find;
-
-    *ind_val = (int*) malloc(0);
-    __m256 vect_val = _mm256_castsi256_ps(_mm256_set1_epi32(val_threads));
-
-    int i, j, mask;
-    for (i = i_start; i + 8 < i_end; i += i_step) {
-        if (stop_threads)
-            pthread_exit(NULL);
-        mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps((float*) (U_threads + i)), vect_val, _CMP_EQ_OS));
-        if (mask) {
-            *ind_val = (int*) realloc(*ind_val, (*nb_find + count_ones_table[mask]) * sizeof(int));
-            for (j = i; mask != 0; j++) {
-                if (mask & 1) {
-                    (*ind_val)[*nb_find] = j;
-                    (*nb_find)++;
-                }
-                mask >>= 1;
-            }
+    size_t size = ((size_t) nb_items * sizeof(int) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    int *U = (int*) aligned_alloc(CACHE_LINE_SIZE, size);
+
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    struct init_data *init_data_array = (struct init_data*) aligned_alloc(CACHE_LINE_SIZE,
+                                                                          nb_threads * sizeof(struct init_data));
+    for (long w_start = 0; w_start < nb_items; w_start += w_size) {
+        int window_items = (int) (nb_items - w_start < w_size ? nb_items - w_start : w_size);
+        split_range(thread_data_array, nb_threads, 0, window_items - 1, 1);
+        for (int t = 0; t < nb_threads; t++) {
+            if (init != NULL)
+                init_data_array[t] = *init;
+            init_data_array[t].U = U;
+            init_data_array[t].i_start = w_start + thread_data_array[t].i_start;
+            init_data_array[t].i_end = w_start + thread_data_array[t].i_end;
         }
+
+        thread_pool_submit(pool, init_function, init_data_array, sizeof(struct init_data), nb_threads);
+        thread_pool_wait(pool);
     }
 
-    for (; i <= i_end; i++)
-        if (U_threads[i] == val_threads) {
-            (*nb_find)++;
-            *ind_val = (int*) realloc(*ind_val, *nb_find * sizeof(int));
-            (*ind_val)[*nb_find - 1] = i;
-        }
+    free(thread_data_array);
+    free(init_data_array);
+    return U;
+}
 
-    pthread_exit(NULL);
+int* alloc_U(int nb_items) {
+    return init_U(zero_thread_function, nb_items, nb_items, NULL);
 }
 
+int* generate_U_seeded(int nb_items, int min_val, int max_val, uint64_t seed) {
+    struct init_data init = {.min_val = min_val, .max_val = max_val, .seed = seed};
+    return init_U(generate_thread_function, nb_items, nb_items, &init);
+}
 
-void *watch_nb_find(void* thread_arg) {
+int* generate_U(int nb_items, int min_val, int max_val) {
+    return generate_U_seeded(nb_items, min_val, max_val, (uint64_t) rand() << 31 ^ rand());
+}
 
-    int *k = (int*) thread_arg;
-    int nb_find;
+int* generate_U_matches(int nb_items, int min_val, int max_val, int val, double density, int cluster_size,
+                        uint64_t seed) {
+    struct init_data init = {.min_val = min_val, .max_val = max_val, .seed = seed, .val = val,
+                             .cluster_size = cluster_size};
+    init.match_threshold = density <= 0 ? 0 : density >= 1 ? 1ull << 32 : (uint64_t) (density * 4294967296.0);
+    return init_U(generate_matches_thread_function, nb_items, nb_items, &init);
+}
 
-    while (true) {
-        usleep(1000);
-        if (stop_threads)
-            pthread_exit(NULL);
-        nb_find = 0;
-        for (int t = 0; t < NB_THREADS; t++)
-            nb_find += nb_find_thread[t];
-        if (nb_find > *k) {
-            stop_threads = true;
-            pthread_exit(NULL);
-        }
-    }
+int* alloc_U64(long nb_items) {
+    return init_U(zero_thread_function, nb_items, FIND64_WINDOW_SIZE, NULL);
 }
 
-int thread_find(int *U, int i_start, int i_end, int i_step, int val, int **ind_val, int k, int ver) {
+int* generate_U64(long nb_items, int min_val, int max_val) {
+    struct init_data init = {.min_val = min_val, .max_val = max_val, .seed = (uint64_t) rand() << 31 ^ rand()};
+    return init_U(generate_thread_function, nb_items, FIND64_WINDOW_SIZE, &init);
+}
 
-    // Check the version to use (scalar of vector computing)
-    void *thread_function;
-    switch (ver) {
-        case 0:
-            thread_function = scalar_thread_function;
-            break;
-        case 1:
-            if (i_step % 8 != 0)
-                return -1;
-            thread_function = vect_thread_function;
-            break;
-        default:
-            printf("Invalid value for \"ver\".\n");
-            return -1;
+/*
+map_U()
+-------
+map_U maps a file of native 32-bit integers in memory (read only) and returns it as U, so that it is searched in place,
+without copying it, and without the time spent by generate_U to fill the array. The number of integers is written in
+nb_items (at most INT_MAX: larger files can be searched with stream_find).
+The mapping is advised as read sequentially (MADV_SEQUENTIAL) and, if huge_pages is true, as backed by transparent
+huge pages when the file system supports it (MADV_HUGEPAGE). Then, each thread of thread_find advises its own chunk (the
+chunk that it searches, see init_U) as needed soon (MADV_WILLNEED) and faults it in by reading one integer in each
+page, so that the pages are mapped in parallel and the first search does not wait for page faults.
+unmap_U releases the mapping.
+*/
+
+void *prefault_thread_function(void* thread_arg) {
+    struct init_data *my_data = (struct init_data*) thread_arg;
+    if (my_data->i_start > my_data->i_end)
+        return NULL;
+    long page_size = sysconf(_SC_PAGESIZE);
+    char *start = (char*) (my_data->U + my_data->i_start);
+    char *end = (char*) (my_data->U + my_data->i_end + 1);
+    char *page = (char*) ((uintptr_t) start / page_size * page_size);
+    madvise(page, end - page, MADV_WILLNEED);
+    volatile int sum = 0;
+    for (char *p = start; p < end; p += page_size)
+        sum += *(int*) p;
+    return NULL;
+}
+
+int* map_U(const char *path, int *nb_items, bool huge_pages) {
+
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        printf("Cannot open \"%s\".\n", path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    long file_items = file_stat.st_size / sizeof(int);
+    if (file_items == 0 || file_items > INT_MAX) {
+        printf("\"%s\" must contain between 1 and %i integers.\n", path, INT_MAX);
+        close(fd);
+        return NULL;
     }
 
-    // Initialize the variables
-    U_threads = U;
-    val_threads = val;
-    int **ind_val_thread[NB_THREADS];
-    for (int t = 0; t < NB_THREADS; t++) {
-        nb_find_thread[t] = 0;
-        ind_val_thread[t] = (int**) malloc(sizeof(int*));
-    }
-
-    // Start watch_nb_find_thread if nescessary
-    pthread_t watch_nb_find_thread;
-    if (k >= 0) {
-        pthread_create(&watch_nb_find_thread, NULL, watch_nb_find, &k);
-    }
-
-    // Initialize the variables that are specific to the threads and start the threads
-    pthread_t threads[NB_THREADS];
-    struct thread_data thread_data_array[NB_THREADS];
-    for (int t = 0; t < NB_THREADS; t++) {
-        thread_data_array[t].i_start = t * ((i_end - i_start) / i_step + 1) / NB_THREADS * i_step + i_start;
-        thread_data_array[t].i_end = (t + 1) * ((i_end - i_start) / i_step + 1) / NB_THREADS * i_step + i_start - 1;
-        thread_data_array[t].i_step = i_step;
-        thread_data_array[t].ind_val = ind_val_thread[t];
-        thread_data_array[t].nb_find = &nb_find_thread[t];
-        pthread_create(&threads[t], NULL, thread_function, (void*) &thread_data_array[t]);
+    int *U = (int*) mmap(NULL, file_items * sizeof(int), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (U == MAP_FAILED) {
+        printf("Cannot map \"%s\".\n", path);
+        return NULL;
     }
+    *nb_items = (int) file_items;
+    madvise(U, file_items * sizeof(int), MADV_SEQUENTIAL);
+    if (huge_pages)
+        madvise(U, file_items * sizeof(int), MADV_HUGEPAGE);
 
-    // Wait for the threads to finish running
-    int nb_find = 0;
-    for (int t = 0; t < NB_THREADS; t++) {
-        pthread_join(threads[t], NULL);
-        nb_find += nb_find_thread[t];
+    // Fault in the chunks of the threads in parallel
+    struct thread_pool *pool = get_find_pool();
+    int nb_threads = pool->nb_threads;
+    struct thread_data *thread_data_array = alloc_thread_data(nb_threads);
+    struct init_data *init_data_array = (struct init_data*) aligned_alloc(CACHE_LINE_SIZE,
+                                                                          nb_threads * sizeof(struct init_data));
+    split_range(thread_data_array, nb_threads, 0, *nb_items - 1, 1);
+    for (int t = 0; t < nb_threads; t++) {
+        init_data_array[t].U = U;
+        init_data_array[t].i_start = thread_data_array[t].i_start;
+        init_data_array[t].i_end = thread_data_array[t].i_end;
     }
 
-    // In case watch_nb_find_thread is still running
-    stop_threads = true;
+    thread_pool_submit(pool, prefault_thread_function, init_data_array, sizeof(struct init_data), nb_threads);
+    thread_pool_wait(pool);
 
-    // Concatenate the arrays that contain the indices of the found occurrences
-    *ind_val = (int*) malloc(nb_find * sizeof(int));
-    int *ind_val_current = *ind_val;
-    for (int t = 0; t < NB_THREADS; t++) {
-        memcpy(ind_val_current, *ind_val_thread[t], nb_find_thread[t] * sizeof(int));
-        ind_val_current += nb_find_thread[t];
+    free(thread_data_array);
+    free(init_data_array);
+    return U;
+}
+
+void unmap_U(int *U, int nb_items) {
+    munmap(U, (size_t) nb_items * sizeof(int));
+}
+
+/*
+Benchmark
+---------
+run_benchmark (./find.out bench [max_size] [csv|json]) measures thread_find for each combination of:
+- the number of integers of U, from the L1 cache to memory (4096 to max_size, 1 << 26 by default, by factors of 16),
+- the density of matches (0 is looked for in U generated by generate_U_matches with BENCH_SEED, so that the inputs are
+  the same from one run to the next),
+- the number of threads (1, 2, 4... up to the default number, see thread_find_configure),
+- k (all the occurrences, or the first BENCH_K),
+- ver (0, 1 and 2 if the processor supports AVX-512, with the step that searches the whole range).
+Each search is run BENCH_WARMUP times, so that U and the buffers are in the caches (when they fit) and the pages of the
+output are mapped, and then BENCH_TRIALS times (at least 100, so that the 99th percentile is not simply the maximum).
+The median and the 99th percentile of the execution times are written as CSV (default) or JSON, with the read
+throughput (bytes of U per second) and its ratio to the read bandwidth of the largest U with the same number of
+threads, which read_bandwidth measures first. The execution times are measured with CLOCK_MONOTONIC (see get_time_ns),
+which does not jump when the system time is changed.
+*/
+
+#define BENCH_WARMUP 2
+#define BENCH_TRIALS 100
+#define BENCH_K 100
+
+#define BENCH_SEED 42
+
+const double BENCH_DENSITIES[] = {1E-4, 1E-2, 0.25};
+
+int compare_longs(const void *a, const void *b) {
+    return (*(const long*) a > *(const long*) b) - (*(const long*) a < *(const long*) b);
+}
+
+// Returns the value that follows value in a sweep up to max (included) by factors of factor, or 0 after max.
+long next_sweep_value(long value, long max, int factor) {
+    return value >= max ? 0 : value * factor < max ? value * factor : max;
+}
+
+// Reads the chunk of the thread with 4 independent 256-bit loads at a time (AVX only has floating point operations).
+void *read_thread_function(void* thread_arg) {
+    struct thread_data *my_data = (struct thread_data*) thread_arg;
+    int *U = my_data->query->U;
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+    int i = my_data->i_start, bits = 0;
+    for (; i + 32 <= my_data->i_end + 1; i += 32)
+        for (int g = 0; g < 4; g++)
+            acc[g] = _mm256_or_ps(acc[g], _mm256_loadu_ps((const float*) (U + i + 8 * g)));
+    for (; i <= my_data->i_end; i++)
+        bits |= U[i];
+    acc[0] = _mm256_or_ps(_mm256_or_ps(acc[0], acc[1]), _mm256_or_ps(acc[2], acc[3]));
+    my_data->nb_find = _mm256_movemask_ps(acc[0]) | bits;
+    return NULL;
+}
+
+// Returns the median read bandwidth (in bytes per second) of nb_items integers of U with the threads of thread_find.
+double read_bandwidth(int *U, int nb_items) {
+
+    struct thread_pool *pool = get_find_pool();
+    struct find_query query = {U, 0, predicate_eq(0), NULL, NULL, 0, NULL};
+    struct thread_data *thread_data_array = alloc_thread_data(pool->nb_threads);
+    long times[BENCH_TRIALS];
+
+    for (int r = -BENCH_WARMUP; r < BENCH_TRIALS; r++) {
+        split_range(thread_data_array, pool->nb_threads, 0, nb_items - 1, 1);
+        for (int t = 0; t < pool->nb_threads; t++)
+            thread_data_array[t].query = &query;
+        long t_start = get_time_ns();
+        run_threads(pool, read_thread_function, thread_data_array);
+        if (r >= 0)
+            times[r] = get_time_ns() - t_start;
     }
+    free(thread_data_array);
 
-    // If necessary, ignore the extra indices
-    if (k >= 0) {
-        if (nb_find > k) {
-            *ind_val = (int*) realloc(*ind_val, k * sizeof(int));
-            nb_find = k;
+    qsort(times, BENCH_TRIALS, sizeof(long), compare_longs);
+    return nb_items * sizeof(int) / (times[BENCH_TRIALS / 2] * 1E-9);
+}
+
+int run_benchmark(int max_size, bool json) {
+
+    int default_threads = get_find_pool()->nb_threads;
+    int nb_vers = avx512_supported() ? 3 : 2;
+    const int steps[] = {1, 8, 16};
+    const int ks[] = {-1, BENCH_K};
+    long times[BENCH_TRIALS];
+    bool first_row = true;
+
+    if (json)
+        printf("[\n");
+    else
+        printf("size,density,threads,k,ver,median_ns,p99_ns,nb_find,gb_per_s,bandwidth_ratio\n");
+
+    for (int d = 0; d < (int) (sizeof(BENCH_DENSITIES) / sizeof(double)); d++) {
+        int *U = generate_U_matches(max_size, 1, 1 << 20, 0, BENCH_DENSITIES[d], 1, BENCH_SEED);
+
+        for (int nb_threads = 1; nb_threads != 0; nb_threads = next_sweep_value(nb_threads, default_threads, 2)) {
+            thread_find_configure(nb_threads, NULL);
+            double bandwidth = read_bandwidth(U, max_size);
+
+            for (long size = max_size < 4096 ? max_size : 4096; size != 0; size = next_sweep_value(size, max_size, 16)) {
+                for (int kk = 0; kk < 2; kk++) {
+                    for (int ver = 0; ver < nb_vers; ver++) {
+
+                        int k = ks[kk];
+                        int nb_find = 0;
+                        for (int r = -BENCH_WARMUP; r < BENCH_TRIALS; r++) {
+                            int *ind_val;
+                            long t_start = get_time_ns();
+                            nb_find = thread_find(U, 0, (int) size - 1, steps[ver], 0, &ind_val, k, ver);
+                            long t_end = get_time_ns();
+                            free(ind_val);
+                            if (r >= 0)
+                                times[r] = t_end - t_start;
+                        }
+                        qsort(times, BENCH_TRIALS, sizeof(long), compare_longs);
+                        long median = times[BENCH_TRIALS / 2];
+                        long p99 = times[(99 * BENCH_TRIALS + 99) / 100 - 1];
+                        double gb_per_s = size * sizeof(int) / (double) median;
+
+                        if (json)
+                            printf("%s  {\"size\": %li, \"density\": %g, \"threads\": %i, \"k\": %i, \"ver\": %i, "
+                                   "\"median_ns\": %li, \"p99_ns\": %li, \"nb_find\": %i, \"gb_per_s\": %.3f, "
+                                   "\"bandwidth_ratio\": %.3f}", first_row ? "" : ",\n", size,
+                                   BENCH_DENSITIES[d], nb_threads, k, ver, median, p99, nb_find, gb_per_s,
+                                   gb_per_s * 1E9 / bandwidth);
+                        else
+                            printf("%li,%g,%i,%i,%i,%li,%li,%i,%.3f,%.3f\n", size, BENCH_DENSITIES[d],
+                                   nb_threads, k, ver, median, p99, nb_find, gb_per_s, gb_per_s * 1E9 / bandwidth);
+                        first_row = false;
+                        fflush(stdout);
+                    }
+                }
+            }
         }
-        pthread_join(watch_nb_find_thread, NULL);
+        free(U);
     }
 
-    return nb_find;
+    if (json)
+        printf("\n]\n");
+    thread_find_configure(default_threads, NULL);
+    return 0;
 }
 
 int main(int argc, char *argv[]){
 
     srand((unsigned) time(NULL));
     initialize_count_ones_table();
+    initialize_permutation_table();
     long t_start, t_end;
     int **ind_val = (int**) malloc(sizeof(int*));
     int nb_find;
 
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+        return run_benchmark(argc >= 3 ? atoi(argv[2]) : 1 << 26, argc >= 4 && strcmp(argv[3], "json") == 0);
+
     bool print_ind = argc >= 2 ? atoi(argv[1]) != 0 : false;
     int size = argc >= 3 ? atoi(argv[2]) : 1E9;
     int min = argc >= 5 ? atoi(argv[3]) : 0;
     int max = argc >= 5 ? atoi(argv[4]) : 100;
     int val = argc >= 6 ? atoi(argv[5]) : rand() % (max - min + 1) + min;
+    int nb_threads = argc >= 7 ? atoi(argv[6]) : 0;
+    const char *path = argc >= 8 ? argv[7] : NULL;
+
+    thread_find_configure(nb_threads, NULL);
 
     printf("Creating a random input array with %i values between %i and %i...\n", size, min, max);
     int *U = generate_U(size, min, max);
@@ -350,6 +4173,15 @@ int main(int argc, char *argv[]){
         printf("\n");
     }
 
+    // Strided vector computing implementation (same indices as find, here every third integer)
+    printf("\nRunning strided vector version (i_step = 3)...\n");
+    t_start = get_time_ns();
+    nb_find = strided_find(U, 0, size - 1, 3, val, ind_val);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    free(*ind_val);
+
     // multithreaded implementation (with vector computing)
     printf("\nRunning multithreaded version...\n");
     t_start = get_time_ns();
@@ -357,6 +4189,259 @@ int main(int argc, char *argv[]){
     t_end = get_time_ns();
     printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
     printf("Found %i valid indices.\n", nb_find);
+#ifdef FIND_STATS
+    find_stats_print(find_get_stats());
+#endif
+    if (print_ind) {
+        printf("Valid indices: ");
+        for (int i = 0; i < nb_find; i++)
+            printf("%i ", (*ind_val)[i]);
+        printf("\n");
+    }
+
+    // Dynamic multithreaded implementation (with vector computing)
+    printf("\nRunning dynamic multithreaded version...\n");
+    t_start = get_time_ns();
+    nb_find = dynamic_thread_find(U, 0, size - 1, 8, val, ind_val, -1, 1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    if (print_ind) {
+        printf("Valid indices: ");
+        for (int i = 0; i < nb_find; i++)
+            printf("%i ", (*ind_val)[i]);
+        printf("\n");
+    }
+
+    // Multithreaded implementation with a search context, whose buffers are reused by the second search
+    printf("\nRunning multithreaded version with a search context (two searches)...\n");
+    struct find_ctx *ctx = find_ctx_create(nb_threads, NULL);
+    const int *ctx_ind_val;
+    for (int r = 0; r < 2; r++) {
+        t_start = get_time_ns();
+        nb_find = find_ctx_find(ctx, U, 0, size - 1, 8, val, &ctx_ind_val, -1, 1);
+        t_end = get_time_ns();
+        printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    }
+    printf("Found %i valid indices.\n", nb_find);
+    if (print_ind) {
+        printf("Valid indices: ");
+        for (int i = 0; i < nb_find; i++)
+            printf("%i ", ctx_ind_val[i]);
+        printf("\n");
+    }
+    find_ctx_destroy(ctx);
+
+    // Two-pass multithreaded implementation (with vector computing)
+    printf("\nRunning two-pass multithreaded version...\n");
+    t_start = get_time_ns();
+    nb_find = two_pass_thread_find(U, 0, size - 1, 8, val, ind_val, -1, 1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    if (print_ind) {
+        printf("Valid indices: ");
+        for (int i = 0; i < nb_find; i++)
+            printf("%i ", (*ind_val)[i]);
+        printf("\n");
+    }
+
+    // Counting implementation
+    printf("\nRunning counting version...\n");
+    t_start = get_time_ns();
+    nb_find = count_only(U, 0, size - 1, 1, val);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i occurrences.\n", nb_find);
+
+    // Multithreaded implementation with 64-bit indices (with vector computing)
+    printf("\nRunning 64-bit multithreaded version...\n");
+    long *ind_val64;
+    t_start = get_time_ns();
+    long nb_find64 = thread_find64(U, 0, size - 1, 8, val, &ind_val64, -1, 1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %li valid indices.\n", nb_find64);
+    if (nb_find64 >= 0)
+        free(ind_val64);
+
+    // Multithreaded implementation on 8-bit integers, if the values fit (with vector computing)
+    if (min >= INT8_MIN && max <= INT8_MAX) {
+        int8_t *U8 = (int8_t*) malloc(size);
+        for (int i = 0; i < size; i++)
+            U8[i] = (int8_t) U[i];
+        printf("\nRunning multithreaded version on 8-bit integers...\n");
+        t_start = get_time_ns();
+        nb_find = thread_find_i8(U8, 0, size - 1, 1, (int8_t) val, ind_val, -1);
+        t_end = get_time_ns();
+        printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+        printf("Found %i valid indices.\n", nb_find);
+        free(*ind_val);
+        free(U8);
+    }
+
+    // Range search (multithreaded, with vector computing)
+    struct predicate range = {PRED_RANGE, val - 1, val + 1};
+    printf("\nRunning multithreaded range version (%i <= U[i] <= %i)...\n", range.val, range.max);
+    t_start = get_time_ns();
+    nb_find = thread_pred_find(U, 0, size - 1, 8, range, ind_val, -1, 1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    free(*ind_val);
+
+    // Batched search (multithreaded, with vector computing): overlapping windows, swept once
+    struct find_request requests[4] = {
+        {0, size - 1, 8, predicate_eq(val)},
+        {0, size / 2, 8, range},
+        {size / 4, size - 1, 8, predicate_eq(val + 2)},
+        {size / 2, size - 1, 16, predicate_eq(val)}
+    };
+    int *batch_ind_vals[4];
+    int batch_nb_finds[4];
+    printf("\nRunning multithreaded batched version (4 requests)...\n");
+    t_start = get_time_ns();
+    nb_find = thread_find_batch(U, requests, 4, batch_ind_vals, batch_nb_finds, 1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices (%i, %i, %i and %i).\n", nb_find, batch_nb_finds[0], batch_nb_finds[1],
+           batch_nb_finds[2], batch_nb_finds[3]);
+    for (int q = 0; q < 4; q++)
+        free(batch_ind_vals[q]);
+
+    // Bitmap output (multithreaded, with vector computing)
+    printf("\nRunning multithreaded bitmap version...\n");
+    struct bitmap bitmap;
+    t_start = get_time_ns();
+    nb_find = thread_bitmap_pred_find(U, 0, size - 1, 1, predicate_eq(val), &bitmap);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    bitmap_free(&bitmap);
+
+    // Value index
+    printf("\nBuilding value index...\n");
+    t_start = get_time_ns();
+    struct value_index *index = value_index_build(U, size);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("\nRunning indexed version...\n");
+    t_start = get_time_ns();
+    nb_find = indexed_find(index, U, 0, size - 1, 1, val, ind_val, -1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    free(*ind_val);
+    value_index_free(index);
+
+    // Dictionary encoding (multithreaded, with vector computing on the codes)
+    printf("\nEncoding U with a dictionary...\n");
+    t_start = get_time_ns();
+    struct dict_U *dict = dict_encode(U, size);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    if (dict != NULL) {
+        printf("%i distinct values, %i-bit codes.\n", dict->nb_values, dict->code_bits);
+        printf("\nRunning dictionary-encoded version...\n");
+        t_start = get_time_ns();
+        nb_find = dict_find(dict, 0, size - 1, 1, val, ind_val, -1);
+        t_end = get_time_ns();
+        printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+        printf("Found %i valid indices.\n", nb_find);
+        free(*ind_val);
+        dict_free(dict);
+    }
+
+    // Zone maps (multithreaded, with vector computing), on a sorted copy of U, whose blocks are mostly skipped
+    int *U_sorted = alloc_U(size);
+    for (int i = 0; i < size; i++)
+        U_sorted[i] = min + (int) ((long) i * (max - min + 1) / size);
+    printf("\nBuilding zone map of sorted U...\n");
+    t_start = get_time_ns();
+    struct zone_map *zone_map = zone_map_build(U_sorted, size);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("\nRunning multithreaded version on sorted U...\n");
+    t_start = get_time_ns();
+    nb_find = thread_find(U_sorted, 0, size - 1, 8, val, ind_val, -1, 1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    free(*ind_val);
+    printf("\nRunning zone map version on sorted U...\n");
+    t_start = get_time_ns();
+    nb_find = zone_map_find(zone_map, U_sorted, 0, size - 1, 8, val, ind_val, -1, 1);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    free(*ind_val);
+    zone_map_free(zone_map);
+    free(U_sorted);
+
+    // Scaling of the multithreaded implementation with the number of threads
+    int max_threads = get_find_pool()->nb_threads;
+    printf("\nRunning multithreaded version with 1 to %i threads...\n", max_threads);
+    for (int n = 1; n <= max_threads; n = n < max_threads && 2 * n > max_threads ? max_threads : 2 * n) {
+        thread_find_configure(n, NULL);
+        t_start = get_time_ns();
+        nb_find = thread_find(U, 0, size - 1, 8, val, ind_val, -1, 1);
+        t_end = get_time_ns();
+        printf("%i threads: %liµs\n", n, (t_end - t_start) / 1000);
+        free(*ind_val);
+    }
+    thread_find_configure(nb_threads, NULL);
+
+    // Streaming search of a file
+    if (path != NULL) {
+        printf("\nRunning streaming version on \"%s\"...\n", path);
+        long *stream_ind_val;
+        t_start = get_time_ns();
+        long nb_stream_find = stream_find(path, val, &stream_ind_val, -1, 1);
+        t_end = get_time_ns();
+        printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+        printf("Found %li valid indices.\n", nb_stream_find);
+        if (nb_stream_find >= 0)
+            free(stream_ind_val);
+    }
+
+    // Search of a mapped file
+    int map_size;
+    int *map = path != NULL ? map_U(path, &map_size, true) : NULL;
+    if (map != NULL) {
+        printf("\nRunning multithreaded version on mapped \"%s\"...\n", path);
+        t_start = get_time_ns();
+        nb_find = thread_find(map, 0, map_size - 1, 8, val, ind_val, -1, 1);
+        t_end = get_time_ns();
+        printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+        printf("Found %i valid indices.\n", nb_find);
+        free(*ind_val);
+        unmap_U(map, map_size);
+    }
+
+    if (!avx512_supported())
+        return 0;
+
+    // AVX-512 vector computing implementation
+    printf("\nRunning AVX-512 vector version...\n");
+    t_start = get_time_ns();
+    nb_find = vect512_find(U, 0, size - 1, 16, val, ind_val);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
+    if (print_ind) {
+        printf("Valid indices: ");
+        for (int i = 0; i < nb_find; i++)
+            printf("%i ", (*ind_val)[i]);
+        printf("\n");
+    }
+
+    // multithreaded implementation (with AVX-512 vector computing)
+    printf("\nRunning AVX-512 multithreaded version...\n");
+    t_start = get_time_ns();
+    nb_find = thread_find(U, 0, size - 1, 16, val, ind_val, -1, 2);
+    t_end = get_time_ns();
+    printf("Done. Execution time: %liµs\n", (t_end - t_start) / 1000);
+    printf("Found %i valid indices.\n", nb_find);
     if (print_ind) {
         printf("Valid indices: ");
         for (int i = 0; i < nb_find; i++)